@@ -0,0 +1,162 @@
+/*
+ *  Worker autoscaling routines
+ *
+ *  The active counts are read by every worker between items, so the
+ *  check is one relaxed load; the lock and condition variable are only
+ *  used to sleep and to be woken.  Once a side is released (producers:
+ *  the quota ran out; consumers: the buffer is about to close) its
+ *  parked workers wake and never park again, so they can finish.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "prodcons.h"
+#include "autoscale.h"
+#include "pcmatrix.h"
+
+static pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t unparked = PTHREAD_COND_INITIALIZER;
+
+static atomic_int active[2];
+static atomic_int released[2];
+static int total[2];
+
+static int low_mark;
+static int high_mark;
+static atomic_int stopping;
+static pthread_t controller;
+
+// Updated by the controller only, read after it has been joined
+static autoscale_stats_t stats;
+static unsigned long ticks;
+static double active_sum[2];
+
+// Park or wake one worker of side; returns 1 if anything changed
+static int adjust(int side, int delta)
+{
+  int n = atomic_load_explicit(&active[side], memory_order_relaxed) + delta;
+  if (n < 1 || n > total[side])
+    return 0;
+  pthread_mutex_lock(&park_mutex);
+  atomic_store_explicit(&active[side], n, memory_order_relaxed);
+  if (delta > 0)
+    pthread_cond_broadcast(&unparked);
+  pthread_mutex_unlock(&park_mutex);
+  if (delta > 0)
+    stats.unparks++;
+  else
+    stats.parks++;
+  return 1;
+}
+
+static void record_tick()
+{
+  for (int side = 0; side < 2; side++)
+  {
+    int n = atomic_load_explicit(&active[side], memory_order_relaxed);
+    active_sum[side] += n;
+    if (n < stats.min_active[side])
+      stats.min_active[side] = n;
+    if (n > stats.max_active[side])
+      stats.max_active[side] = n;
+  }
+  ticks++;
+}
+
+static void *controller_main(void *arg)
+{
+  long occupied = 0;
+  int samples = 0;
+  while (!atomic_load_explicit(&stopping, memory_order_acquire))
+  {
+    usleep(AUTOSCALE_SAMPLE_US);
+    occupied += buffer_occupancy();
+    record_tick();
+    if (++samples < AUTOSCALE_PERIOD_SAMPLES)
+      continue;
+
+    // Average occupancy over the period as a percentage of the bound
+    long pct = occupied * 100 / ((long) samples * BOUNDED_BUFFER_SIZE);
+    occupied = 0;
+    samples = 0;
+    if (pct > high_mark)
+    {
+      if (!adjust(SIDE_CONSUMERS, +1))
+        adjust(SIDE_PRODUCERS, -1);
+    }
+    else if (pct < low_mark)
+    {
+      if (!adjust(SIDE_PRODUCERS, +1))
+        adjust(SIDE_CONSUMERS, -1);
+    }
+  }
+  return NULL;
+}
+
+// Start the controller with every worker active
+int autoscale_start(int producers, int consumers, int low_pct, int high_pct)
+{
+  total[SIDE_PRODUCERS] = producers;
+  total[SIDE_CONSUMERS] = consumers;
+  for (int side = 0; side < 2; side++)
+  {
+    atomic_init(&active[side], total[side]);
+    atomic_init(&released[side], 0);
+    stats.min_active[side] = total[side];
+    stats.max_active[side] = total[side];
+    active_sum[side] = 0;
+  }
+  low_mark = low_pct;
+  high_mark = high_pct;
+  ticks = 0;
+  atomic_init(&stopping, 0);
+  return pthread_create(&controller, NULL, controller_main, NULL);
+}
+
+// Called by worker index of side between items; sleeps while parked
+void autoscale_park_point(int side, int index)
+{
+  if (index < atomic_load_explicit(&active[side], memory_order_relaxed))
+    return;
+  pthread_mutex_lock(&park_mutex);
+  while (index >= atomic_load_explicit(&active[side], memory_order_relaxed) &&
+         !atomic_load_explicit(&released[side], memory_order_relaxed))
+    pthread_cond_wait(&unparked, &park_mutex);
+  pthread_mutex_unlock(&park_mutex);
+}
+
+// Wake every parked worker of side for good
+void autoscale_release(int side)
+{
+  if (atomic_load_explicit(&released[side], memory_order_relaxed))
+    return;
+  pthread_mutex_lock(&park_mutex);
+  atomic_store_explicit(&released[side], 1, memory_order_relaxed);
+  pthread_cond_broadcast(&unparked);
+  pthread_mutex_unlock(&park_mutex);
+}
+
+// Stop the controller and release both sides
+void autoscale_stop()
+{
+  atomic_store_explicit(&stopping, 1, memory_order_release);
+  pthread_join(controller, NULL);
+  autoscale_release(SIDE_PRODUCERS);
+  autoscale_release(SIDE_CONSUMERS);
+}
+
+// Call after autoscale_stop()
+void autoscale_stats(autoscale_stats_t *st)
+{
+  *st = stats;
+  for (int side = 0; side < 2; side++)
+    st->avg_active[side] = ticks ? active_sum[side] / ticks : total[side];
+}
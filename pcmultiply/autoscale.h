@@ -0,0 +1,46 @@
+/*
+ *  autoscale header
+ *  Function prototypes, data, and constants for the worker autoscaling module
+ *
+ *  Every producer and consumer thread is created up front; the controller
+ *  thread decides how many of each are active.  It samples the buffer's
+ *  occupancy and, once per decision period, compares the average with
+ *  the low and high watermarks:
+ *
+ *    above high - consumers are the bottleneck and producers sit blocked:
+ *                 wake a parked consumer, or else park a producer
+ *    below low  - producers are the bottleneck and consumers sit blocked:
+ *                 wake a parked producer, or else park a consumer
+ *
+ *  Workers with index >= the active count of their side park between
+ *  items.  At least one worker of each side always stays active.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Controller timing
+#define AUTOSCALE_SAMPLE_US 200
+#define AUTOSCALE_PERIOD_SAMPLES 25
+
+// Watermarks, percent of the bounded buffer size
+#define DEFAULT_AUTOSCALE_LOW 25
+#define DEFAULT_AUTOSCALE_HIGH 75
+
+// AUTOSCALING
+
+// run summary, filled in by autoscale_stats()
+typedef struct __autoscale_stats_t {
+  double avg_active[2];      // time-weighted active workers per side
+  int min_active[2];
+  int max_active[2];
+  unsigned long parks;       // controller decisions to park a worker
+  unsigned long unparks;     // controller decisions to wake one
+} autoscale_stats_t;
+
+// autoscale methods
+int autoscale_start(int producers, int consumers, int low_pct, int high_pct);
+void autoscale_park_point(int side, int index);
+void autoscale_release(int side);
+void autoscale_stop();
+void autoscale_stats(autoscale_stats_t *st);
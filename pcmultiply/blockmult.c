@@ -0,0 +1,134 @@
+/*
+ *  Blocked multiply routines
+ *
+ *  Cache-blocked, multi-threaded product for large matrices.  Each task
+ *  owns one output tile outright, so no two threads ever write the same
+ *  element and no locking is needed beyond handing out the tasks.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "kernels.h"
+#include "tpool.h"
+#include "blockmult.h"
+#include "pcmatrix.h"
+
+// One product in flight
+typedef struct __blockmult_job_t {
+  Matrix * a;
+  Matrix * b;
+  Matrix * c;
+  int * packed;  // b, packed panel by panel (see pack_panel)
+  int tiles_n;   // tiles across the columns of c
+  int panels_k;  // BLOCK_KC steps along the shared dimension
+} blockmult_job_t;
+
+// The helper threads are only started by the first large product
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_started = 0;
+
+static void start_pool()
+{
+  if (tpool_init(MULT_THREADS) == 0)
+    pool_started = 1;
+}
+
+// Rows k0 .. k0+depth of b start at packed + k0 * b->cols; within them the
+// panel for the columns j0 .. j0+cols is a dense depth x cols block at
+// offset depth * j0.  So packed holds exactly the elements of b.
+static int * panel_at(blockmult_job_t *job, int k0, int depth, int j0)
+{
+  return job->packed + (size_t) k0 * job->b->cols + (size_t) depth * j0;
+}
+
+// Pack one BLOCK_KC x BLOCK_NC panel of b; task = panel * tiles_n + tile
+static void pack_panel(void *arg, int task)
+{
+  blockmult_job_t *job = (blockmult_job_t *) arg;
+  Matrix *b = job->b;
+  int k0 = (task / job->tiles_n) * BLOCK_KC;
+  int j0 = (task % job->tiles_n) * BLOCK_NC;
+  int depth = (b->rows - k0 < BLOCK_KC) ? b->rows - k0 : BLOCK_KC;
+  int cols = (b->cols - j0 < BLOCK_NC) ? b->cols - j0 : BLOCK_NC;
+  int *panel = panel_at(job, k0, depth, j0);
+  for (int x = 0; x < depth; x++)
+    memcpy(panel + (size_t) x * cols, MATRIX_ROW(b, k0 + x) + j0, sizeof(int) * cols);
+}
+
+// Compute one BLOCK_MC x BLOCK_NC tile of c
+static void multiply_tile(void *arg, int task)
+{
+  blockmult_job_t *job = (blockmult_job_t *) arg;
+  Matrix *a = job->a;
+  Matrix *c = job->c;
+
+  int i0 = (task / job->tiles_n) * BLOCK_MC;
+  int j0 = (task % job->tiles_n) * BLOCK_NC;
+  int rows = (c->rows - i0 < BLOCK_MC) ? c->rows - i0 : BLOCK_MC;
+  int cols = (c->cols - j0 < BLOCK_NC) ? c->cols - j0 : BLOCK_NC;
+  mult_kernel_t acc = select_multacc_kernel(cols);
+
+  for (int k0 = 0; k0 < a->cols; k0 += BLOCK_KC)
+  {
+    int depth = (a->cols - k0 < BLOCK_KC) ? a->cols - k0 : BLOCK_KC;
+
+    // The first panel writes the tile, later ones add into it
+    mult_kernel_t kernel = (k0 == 0) ? select_mult_kernel(rows, depth, cols) : acc;
+    kernel(MATRIX_ROW(a, i0) + k0, a->stride, panel_at(job, k0, depth, j0), cols,
+           MATRIX_ROW(c, i0) + j0, c->stride, rows, depth, cols);
+  }
+}
+
+// Start the helper threads, once; also used by other parallel products
+void blocked_start_pool()
+{
+  pthread_once(&pool_once, start_pool);
+}
+
+// result = m1 * m2; result is already allocated with the right shape
+void blocked_multiply(Matrix * m1, Matrix * m2, Matrix * result)
+{
+  if (m1->cols == 0)
+  {
+    for (int i = 0; i < result->rows; i++)
+      memset(MATRIX_ROW(result, i), 0, sizeof(int) * result->cols);
+    return;
+  }
+
+  blockmult_job_t job;
+  job.a = m1;
+  job.b = m2;
+  job.c = result;
+  job.tiles_n = (result->cols + BLOCK_NC - 1) / BLOCK_NC;
+  job.panels_k = (m1->cols + BLOCK_KC - 1) / BLOCK_KC;
+  int tiles_m = (result->rows + BLOCK_MC - 1) / BLOCK_MC;
+  job.packed = (int *) aligned_alloc(MATRIX_ALIGN,
+      ((sizeof(int) * m2->rows * m2->cols + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN);
+  if (job.packed == NULL)
+  {
+    // No room to pack: one unblocked product on this thread
+    mult_kernel_t kernel = select_mult_kernel(m1->rows, m1->cols, m2->cols);
+    kernel(m1->data, m1->stride, m2->data, m2->stride,
+           result->data, result->stride, m1->rows, m1->cols, m2->cols);
+    return;
+  }
+
+  blocked_start_pool();
+  tpool_run(pack_panel, &job, job.panels_k * job.tiles_n);
+  tpool_run(multiply_tile, &job, tiles_m * job.tiles_n);
+  free(job.packed);
+}
+
+// Stop the helper threads, if a large product ever started them
+void blocked_shutdown()
+{
+  if (pool_started)
+    tpool_shutdown();
+}
@@ -0,0 +1,36 @@
+/*
+ *  blockmult header
+ *  Function prototypes, data, and constants for the blocked multiply module
+ *
+ *  Large products are cut into BLOCK_MC x BLOCK_NC output tiles that run
+ *  as tasks on the thread pool.  Each task walks the shared dimension in
+ *  BLOCK_KC steps, multiplying against the matching BLOCK_KC x BLOCK_NC
+ *  panel of the right-hand matrix.
+ *
+ *  Those panels are packed once per product, each into a contiguous,
+ *  L2-sized block, by a first round of tasks; every row tile of a column
+ *  then reads the same packed panels, so packing costs one copy of the
+ *  right-hand matrix however many row tiles there are.  The left-hand
+ *  matrix is not packed: a tile reads it as BLOCK_MC row slices of
+ *  BLOCK_KC consecutive ints each, already contiguous and read in order,
+ *  so a copy would only add traffic.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Tile sizes in elements: the packed panel is BLOCK_KC * BLOCK_NC ints
+// (128 KB), a row slice of the left matrix BLOCK_KC ints (1 KB)
+#define BLOCK_MC 64
+#define BLOCK_NC 128
+#define BLOCK_KC 256
+
+// Products with any dimension at least this large take the blocked path
+#define DEFAULT_PARALLEL_THRESHOLD 256
+
+// BLOCKED MULTIPLY
+
+// blocked multiply methods
+void blocked_multiply(Matrix * m1, Matrix * m2, Matrix * result);
+void blocked_start_pool();
+void blocked_shutdown();
@@ -0,0 +1,133 @@
+/*
+ *  Matrix chain routines
+ *
+ *  The dynamic program fills cost[i][j] for every run Ai..Aj in order of
+ *  increasing length; a run's best cost is the cheapest split s into
+ *  Ai..As and As+1..Aj plus the product of the two halves, dims[i] *
+ *  dims[s+1] * dims[j+1].  Ties keep the leftmost split, so a chain with
+ *  no better order is multiplied left to right.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include "matrix.h"
+#include "chain.h"
+
+int chain_init(chain_t *c, int max)
+{
+  c->max = max;
+  c->k = 0;
+  c->cost = (unsigned long long *) malloc(sizeof(unsigned long long) * max * max);
+  c->split = (int *) malloc(sizeof(int) * max * max);
+  c->dims = (int *) malloc(sizeof(int) * (max + 1));
+  if (c->cost == NULL || c->split == NULL || c->dims == NULL)
+  {
+    chain_free(c);
+    return -1;
+  }
+  return 0;
+}
+
+void chain_free(chain_t *c)
+{
+  free(c->cost);
+  free(c->split);
+  free(c->dims);
+  c->cost = NULL;
+  c->split = NULL;
+  c->dims = NULL;
+}
+
+// Find the cheapest order for ms[0..k-1], which must be compatible
+void chain_plan(chain_t *c, Matrix **ms, int k)
+{
+  int max = c->max;
+  c->k = k;
+  for (int i = 0; i < k; i++)
+    c->dims[i] = ms[i]->rows;
+  c->dims[k] = ms[k - 1]->cols;
+
+  for (int i = 0; i < k; i++)
+    c->cost[i * max + i] = 0;
+  for (int len = 2; len <= k; len++)
+  {
+    for (int i = 0; i + len <= k; i++)
+    {
+      int j = i + len - 1;
+      unsigned long long best = ~0ULL;
+      int best_s = i;
+      for (int s = i; s < j; s++)
+      {
+        unsigned long long cost = c->cost[i * max + s] + c->cost[(s + 1) * max + j] +
+                                  (unsigned long long) c->dims[i] * c->dims[s + 1] * c->dims[j + 1];
+        if (cost < best)
+        {
+          best = cost;
+          best_s = s;
+        }
+      }
+      c->cost[i * max + j] = best;
+      c->split[i * max + j] = best_s;
+    }
+  }
+  c->best = c->cost[k - 1];
+
+  c->left_to_right = 0;
+  for (int i = 1; i < k; i++)
+    c->left_to_right += (unsigned long long) c->dims[0] * c->dims[i] * c->dims[i + 1];
+}
+
+static Matrix * execute(chain_t *c, Matrix **ms, int i, int j)
+{
+  if (i == j)
+    return ms[i];
+  int s = c->split[i * c->max + j];
+  Matrix *left = execute(c, ms, i, s);
+  Matrix *right = execute(c, ms, s + 1, j);
+  Matrix *product = (left != NULL && right != NULL) ? MatrixMultiply(left, right) : NULL;
+  // Intermediates are ours to free; the chain's own matrices are not
+  if (s > i && left != NULL)
+    FreeMatrix(left);
+  if (s + 1 < j && right != NULL)
+    FreeMatrix(right);
+  return product;
+}
+
+// Multiply the chain last planned, in the planned order; ms is unchanged.
+// NULL if any product in it could not be computed
+Matrix * chain_execute(chain_t *c, Matrix **ms)
+{
+  return execute(c, ms, 0, c->k - 1);
+}
+
+// Upper bound on the bytes chain_format_order() writes
+size_t chain_order_size(chain_t *c)
+{
+  // per matrix: "A" + up to 2 digits + a space + one '(' and one ')'
+  return 6 * (size_t) c->k + 1;
+}
+
+static char * format(chain_t *c, char *p, int i, int j)
+{
+  if (i == j)
+    return p + sprintf(p, "A%d", i + 1);
+  int s = c->split[i * c->max + j];
+  *p++ = '(';
+  p = format(c, p, i, s);
+  *p++ = ' ';
+  p = format(c, p, s + 1, j);
+  *p++ = ')';
+  return p;
+}
+
+// Write the planned order as text such as "((A1 A2) A3)"; returns its length
+size_t chain_format_order(chain_t *c, char *buf)
+{
+  char *end = format(c, buf, 0, c->k - 1);
+  *end = '\0';
+  return (size_t) (end - buf);
+}
@@ -0,0 +1,39 @@
+/*
+ *  chain header
+ *  Function prototypes, data, and constants for the matrix chain module
+ *
+ *  A chain A1 A2 ... Ak (each A(i) cols == A(i+1) rows) can be multiplied
+ *  in any parenthesization with the same result, but the arithmetic
+ *  differs widely: (10x1 1x10) 10x1 costs 200 scalar multiplies, while
+ *  10x1 (1x10 10x1) costs 20.  chain_plan() finds the cheapest order with
+ *  the classic O(k^3) dynamic program over the k + 1 dimensions, and
+ *  chain_execute() carries it out, freeing each intermediate as soon as
+ *  the next step has used it.
+ *
+ *  Costs count scalar multiplies: an (r x k) by (k x n) product is r*k*n.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Longest chain --chain accepts
+#define CHAIN_MAX 64
+
+// per-consumer workspace, sized for up to max matrices
+typedef struct __chain_t {
+  int max;
+  int k;                            // matrices in the planned chain
+  unsigned long long * cost;        // cost[i * max + j]: best for Ai..Aj
+  int * split;                      // split[i * max + j]: last step is (Ai..As)(As+1..Aj)
+  int * dims;                       // k + 1 dimensions
+  unsigned long long best;          // cost of the planned order
+  unsigned long long left_to_right; // cost of ((A1 A2) A3) ...
+} chain_t;
+
+// chain methods
+int chain_init(chain_t *c, int max);
+void chain_free(chain_t *c);
+void chain_plan(chain_t *c, Matrix **ms, int k);
+Matrix * chain_execute(chain_t *c, Matrix **ms);
+size_t chain_order_size(chain_t *c);
+size_t chain_format_order(chain_t *c, char *buf);
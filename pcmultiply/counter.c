@@ -1,6 +1,9 @@
 /*
  *  Synchronized counter routines
  *
+ *  Threads are assigned shards round-robin the first time they touch any
+ *  counter, and keep the same shard index for every counter.
+ *
  *  University of Washington, Tacoma
  *  TCSS 422 - Operating Systems
  */
@@ -10,23 +13,54 @@
 #include <pthread.h>
 #include "counter.h"
 
+static atomic_int next_shard = 0;
+static __thread int my_shard = -1;
+
+static inline int thread_shard()
+{
+  if (my_shard < 0)
+    my_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % COUNTER_SHARDS;
+  return my_shard;
+}
+
 // SYNCHRONIZED COUNTER METHOD IMPLEMENTATION
-// Based on Three Easy Pieces
+// Sloppy-counter idea from Three Easy Pieces, ch. 29, without the
+// threshold: shards are atomic, so the global value is always exact
 
 void init_cnt(counter_t *c)  {
-  c->value = 0;
-  pthread_mutex_init(&c->lock, NULL);
+  for (int i = 0; i < COUNTER_SHARDS; i++)
+    atomic_init(&c->shards[i].value, 0);
 }
 
 void increment_cnt(counter_t *c)  {
-  pthread_mutex_lock(&c->lock);
-  c->value++;
-  pthread_mutex_unlock(&c->lock);
+  add_cnt(c, 1);
+}
+
+void add_cnt(counter_t *c, long n)  {
+  atomic_fetch_add_explicit(&c->shards[thread_shard()].value, n, memory_order_relaxed);
+}
+
+long get_cnt(counter_t *c)  {
+  long sum = 0;
+  for (int i = 0; i < COUNTER_SHARDS; i++)
+    sum += atomic_load_explicit(&c->shards[i].value, memory_order_relaxed);
+  return sum;
+}
+
+// QUOTA METHOD IMPLEMENTATION
+
+void init_quota(quota_t *q)  {
+  atomic_init(&q->claimed, 0);
 }
 
-int get_cnt(counter_t *c)  {
-  pthread_mutex_lock(&c->lock);
-  int rc = c->value;
-  pthread_mutex_unlock(&c->lock);
-  return rc;
+// Claim up to want of the limit items; returns how many were granted,
+// 0 once the quota is used up.  The grant is items first .. first+n-1
+// (first may be NULL).  One atomic per call, however many granted.
+int claim_quota(quota_t *q, long limit, int want, long *first)  {
+  long start = atomic_fetch_add_explicit(&q->claimed, want, memory_order_relaxed);
+  if (first != NULL)
+    *first = start;
+  if (start >= limit)
+    return 0;
+  return (limit - start < want) ? (int) (limit - start) : want;
 }
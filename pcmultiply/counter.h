@@ -2,16 +2,35 @@
  *  counter header
  *  Function prototypes, data, and constants for synchronized counter module
  *
+ *  A counter is split into COUNTER_SHARDS cache-line sized shards.  Each
+ *  thread adds to its own shard with one atomic instruction, so threads
+ *  never contend on a lock or bounce a shared line; get_cnt() sums the
+ *  shards.  The sum is exact: every add that completed before get_cnt()
+ *  began is included.
+ *
+ *  A quota hands out a fixed number of work items in chunks, one atomic
+ *  fetch-and-add per chunk.
+ *
  *  University of Washington, Tacoma
  *  TCSS 422 - Operating Systems
  */
 
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+
+// Shards per counter; threads beyond this share shards, still exactly
+#define COUNTER_SHARDS 64
+
 // SYNCHRONIZED COUNTER
 
-// counter structures
+// counter structures - one shard per cache line
+typedef struct __counter_shard_t {
+  _Alignas(CACHE_LINE) atomic_long value;
+} counter_shard_t;
+
 typedef struct __counter_t {
-  int value;
-  pthread_mutex_t  lock;
+  counter_shard_t shards[COUNTER_SHARDS];
 } counter_t;
 
 typedef struct __counters_t {
@@ -19,7 +38,17 @@ typedef struct __counters_t {
   counter_t * cons;
 } counters_t;
 
+// quota structure - number of items claimed so far, may overshoot the limit
+typedef struct __quota_t {
+  _Alignas(CACHE_LINE) atomic_long claimed;
+} quota_t;
+
 // counter methods
 void init_cnt(counter_t *c);
 void increment_cnt(counter_t *c);
-int get_cnt(counter_t *c);
+void add_cnt(counter_t *c, long n);
+long get_cnt(counter_t *c);
+
+// quota methods
+void init_quota(quota_t *q);
+int claim_quota(quota_t *q, long limit, int want, long *first);
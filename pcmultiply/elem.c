@@ -0,0 +1,183 @@
+/*
+ *  Element type routines
+ *
+ *  ELEM_ROUTINES expands to one set of generate / sum / multiply / format
+ *  routines per element type, so each loop is compiled with its storage
+ *  and accumulator types fixed and vectorizes like the int versions.
+ *  The tables at the bottom map a type code to them.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "elem.h"
+#include "rng.h"
+#include "pcmatrix.h"
+
+// Columns of the multiply accumulator kept on the stack
+#define ELEM_ACC_STACK 256
+
+// Widest element text: "-9223372036854775808", or "%g" of a double
+#define ELEM_TEXT_MAX 21
+
+static char * format_integer(char * p, long long v)
+{
+  return p + sprintf(p, "%3lld", v);
+}
+
+static char * format_real(char * p, double v)
+{
+  return p + sprintf(p, "%3g", v);
+}
+
+#define FORMAT_VALUE(p, v) \
+  _Generic((v), float: format_real, double: format_real, default: format_integer)(p, v)
+
+// Integer sums are taken modulo 2^64, which is exact for everything but
+// i64 matrices of huge elements; real sums are rounded to an integer
+#define SUM_TYPE(v) _Generic((v), float: (double) 0, double: (double) 0, default: (unsigned long long) 0)
+
+#define ELEM_ROUTINES(code, name, T, ACC, P, PT) \
+static void gen_##name(Matrix * mat) \
+{ \
+  rng_t * rng = rng_thread(); \
+  long long sum = 0; \
+  for (int i = 0; i < mat->rows; i++) \
+  { \
+    T * mm = &MATRIX_AT(mat, T, i, 0); \
+    for (int j = 0; j < mat->cols; j++) \
+    { \
+      int v = (MATRIX_MODE == 0) ? 1 + rng_range(rng, 10) : 1; \
+      mm[j] = (T) v; \
+      sum += v; \
+    } \
+  } \
+  mat->sum = sum; \
+} \
+\
+static long long sum_##name(Matrix * mat) \
+{ \
+  __typeof__(SUM_TYPE((T) 0)) sum = 0; \
+  for (int i = 0; i < mat->rows; i++) \
+  { \
+    const T * mm = &MATRIX_AT(mat, T, i, 0); \
+    for (int j = 0; j < mat->cols; j++) \
+      sum += mm[j]; \
+  } \
+  return (long long) sum; \
+} \
+\
+static int mult_##name(Matrix * m1, Matrix * m2, Matrix * result) \
+{ \
+  int n = m2->cols; \
+  ACC stack[ELEM_ACC_STACK]; \
+  ACC * acc = (n <= ELEM_ACC_STACK) ? stack : (ACC *) malloc(sizeof(ACC) * n); \
+  if (acc == NULL) \
+    return -1; \
+  for (int i = 0; i < m1->rows; i++) \
+  { \
+    const T * a = &MATRIX_AT(m1, T, i, 0); \
+    for (int j = 0; j < n; j++) \
+      acc[j] = 0; \
+    for (int k = 0; k < m1->cols; k++) \
+    { \
+      ACC aik = (ACC) a[k]; \
+      const T * b = &MATRIX_AT(m2, T, k, 0); \
+      for (int j = 0; j < n; j++) \
+        acc[j] += aik * (ACC) b[j]; \
+    } \
+    PT * c = &MATRIX_AT(result, PT, i, 0); \
+    for (int j = 0; j < n; j++) \
+      c[j] = (PT) acc[j]; \
+  } \
+  if (acc != stack) \
+    free(acc); \
+  return 0; \
+} \
+\
+static size_t format_##name(Matrix * mat, char * buf) \
+{ \
+  char * p = buf; \
+  for (int i = 0; i < mat->rows; i++) \
+  { \
+    const T * mm = &MATRIX_AT(mat, T, i, 0); \
+    *p++ = '|'; \
+    for (int j = 0; j < mat->cols; j++) \
+    { \
+      if (j != 0) \
+        *p++ = ' '; \
+      p = FORMAT_VALUE(p, mm[j]); \
+    } \
+    *p++ = '|'; \
+    *p++ = '\n'; \
+  } \
+  return (size_t) (p - buf); \
+}
+
+ELEM_TYPES(ELEM_ROUTINES)
+
+// ELEMENT TYPE TABLES
+
+#define NAME_ENTRY(code, name, T, ACC, P, PT) [code] = #name,
+#define SIZE_ENTRY(code, name, T, ACC, P, PT) [code] = sizeof(T),
+#define PRODUCT_ENTRY(code, name, T, ACC, P, PT) [code] = P,
+#define GEN_ENTRY(code, name, T, ACC, P, PT) [code] = gen_##name,
+#define SUM_ENTRY(code, name, T, ACC, P, PT) [code] = sum_##name,
+#define MULT_ENTRY(code, name, T, ACC, P, PT) [code] = mult_##name,
+#define FORMAT_ENTRY(code, name, T, ACC, P, PT) [code] = format_##name,
+
+const char * const elem_names[ELEM_COUNT] = { ELEM_TYPES(NAME_ENTRY) };
+const int elem_sizes[ELEM_COUNT] = { ELEM_TYPES(SIZE_ENTRY) };
+const int elem_products[ELEM_COUNT] = { ELEM_TYPES(PRODUCT_ENTRY) };
+
+static void (* const gen_fns[ELEM_COUNT])(Matrix *) = { ELEM_TYPES(GEN_ENTRY) };
+static long long (* const sum_fns[ELEM_COUNT])(Matrix *) = { ELEM_TYPES(SUM_ENTRY) };
+static int (* const mult_fns[ELEM_COUNT])(Matrix *, Matrix *, Matrix *) = { ELEM_TYPES(MULT_ENTRY) };
+static size_t (* const format_fns[ELEM_COUNT])(Matrix *, char *) = { ELEM_TYPES(FORMAT_ENTRY) };
+
+// ELEMENT ROUTINES
+
+// Type code for a name such as "i16", or -1 if there is none
+int elem_lookup(const char *name)
+{
+  for (int i = 0; i < ELEM_COUNT; i++)
+    if (strcmp(name, elem_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+// Fill mat with the run's values (1..10, or all ones) and set mat->sum
+void elem_gen(Matrix *mat)
+{
+  gen_fns[mat->elem](mat);
+}
+
+long long elem_sum(Matrix *mat)
+{
+  return sum_fns[mat->elem](mat);
+}
+
+// result (elem_products[m1->elem], m1->rows x m2->cols) = m1 x m2, where
+// m1 and m2 have the same element type; returns -1 if the row accumulator
+// cannot be allocated
+int elem_multiply(Matrix *m1, Matrix *m2, Matrix *result)
+{
+  return mult_fns[m1->elem](m1, m2, result);
+}
+
+// Upper bound on the bytes elem_format() writes for mat
+size_t elem_format_size(Matrix *mat)
+{
+  // per row: "|" + cols * (" " + element) + "|\n", plus sprintf's NUL
+  return (size_t) mat->rows * (3 + (size_t) mat->cols * (1 + ELEM_TEXT_MAX)) + 1;
+}
+
+// Render mat like DisplayMatrix() ("%3d" style columns) into buf
+size_t elem_format(Matrix *mat, char *buf)
+{
+  return format_fns[mat->elem](mat, buf);
+}
@@ -0,0 +1,58 @@
+/*
+ *  elem header
+ *  Function prototypes, data, and constants for the element type module
+ *
+ *  Every matrix of a run stores its elements as one of the types below,
+ *  picked with --elem.  ELEM_I32 is the original int matrix and keeps
+ *  the SIMD kernels, the blocked and Strassen multiplies and the binary
+ *  stream format; the other types get a plain routine per operation,
+ *  generated from ELEM_TYPES so each one is compiled for its own type.
+ *
+ *  Narrow types only narrow the storage.  Products and sums widen every
+ *  element first, so an i8 or i16 product is an i32 matrix holding
+ *  exactly what the i32 multiply gives for the same values (the values
+ *  generated, 1..10, fit every type).  i64 multiplies modulo 2^64; f32
+ *  and f64 accumulate in double.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdint.h>
+
+// Element type codes; ELEM_I32 is 0 so zeroed globals mean int
+#define ELEM_I32 0
+#define ELEM_I8 1
+#define ELEM_I16 2
+#define ELEM_I64 3
+#define ELEM_F32 4
+#define ELEM_F64 5
+#define ELEM_COUNT 6
+
+// X(code, name, storage type, accumulator type, product code, product storage type)
+// The accumulator of the integer types is unsigned so overflow wraps as
+// in the int kernels.
+#define ELEM_TYPES(X) \
+  X(ELEM_I32, i32, int32_t, uint32_t, ELEM_I32, int32_t) \
+  X(ELEM_I8,  i8,  int8_t,  uint32_t, ELEM_I32, int32_t) \
+  X(ELEM_I16, i16, int16_t, uint32_t, ELEM_I32, int32_t) \
+  X(ELEM_I64, i64, int64_t, uint64_t, ELEM_I64, int64_t) \
+  X(ELEM_F32, f32, float,   double,   ELEM_F32, float) \
+  X(ELEM_F64, f64, double,  double,   ELEM_F64, double)
+
+// Element (i, j) of mat, whose elements are of type T
+#define MATRIX_AT(mat, T, i, j) (((T *) (mat)->data)[(size_t) (i) * (mat)->stride + (j)])
+
+// ELEMENT TYPE TABLES, indexed by code
+
+extern const char * const elem_names[ELEM_COUNT];
+extern const int elem_sizes[ELEM_COUNT];
+extern const int elem_products[ELEM_COUNT];   // element type of a product
+
+// element routines, dispatched on mat->elem
+int elem_lookup(const char *name);
+void elem_gen(Matrix *mat);
+long long elem_sum(Matrix *mat);
+int elem_multiply(Matrix *m1, Matrix *m2, Matrix *result);
+size_t elem_format_size(Matrix *mat);
+size_t elem_format(Matrix *mat, char *buf);
@@ -0,0 +1,105 @@
+/*
+ *  Histogram routines
+ *
+ *  Bucket layout: values below HIST_SUB have a bucket each.  A larger
+ *  value with its highest set bit at position b lands in group
+ *  b - HIST_SUB_BITS + 1, sub-bucket given by the HIST_SUB_BITS bits
+ *  below the leading one.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hist.h"
+
+static inline int bucket_of(uint64_t v)
+{
+  if (v < HIST_SUB)
+    return (int) v;
+  int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB + (int) ((v >> shift) - HIST_SUB);
+}
+
+// Midpoint of the values that fall in bucket i
+static uint64_t bucket_value(int i)
+{
+  if (i < HIST_SUB)
+    return (uint64_t) i;
+  int shift = i / HIST_SUB - 1;
+  uint64_t low = (uint64_t) (HIST_SUB + i % HIST_SUB) << shift;
+  return low + (((uint64_t) 1 << shift) >> 1);
+}
+
+hist_t * hist_new()
+{
+  hist_t *h = (hist_t *) malloc(sizeof(hist_t));
+  if (h != NULL)
+    hist_init(h);
+  return h;
+}
+
+void hist_init(hist_t *h)
+{
+  memset(h, 0, sizeof(hist_t));
+  h->min = UINT64_MAX;
+}
+
+void hist_record(hist_t *h, uint64_t v)
+{
+  h->counts[bucket_of(v)]++;
+  h->total++;
+  h->sum += (double) v;
+  if (v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+  for (int i = 0; i < HIST_BUCKETS; i++)
+    dst->counts[i] += src->counts[i];
+  dst->total += src->total;
+  dst->sum += src->sum;
+  if (src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+// Value at percentile p (0..100); 0 for an empty histogram
+uint64_t hist_percentile(const hist_t *h, double p)
+{
+  if (h->total == 0)
+    return 0;
+  uint64_t rank = (uint64_t) (p / 100.0 * (double) h->total + 0.5);
+  if (rank < 1)
+    rank = 1;
+  if (rank > h->total)
+    rank = h->total;
+  uint64_t seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++)
+  {
+    seen += h->counts[i];
+    if (seen >= rank)
+    {
+      uint64_t v = bucket_value(i);
+      // Never report outside what was actually recorded
+      if (v < h->min)
+        v = h->min;
+      if (v > h->max)
+        v = h->max;
+      return v;
+    }
+  }
+  return h->max;
+}
+
+double hist_mean(const hist_t *h)
+{
+  return (h->total == 0) ? 0.0 : h->sum / (double) h->total;
+}
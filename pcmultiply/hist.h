@@ -0,0 +1,46 @@
+/*
+ *  hist header
+ *  Function prototypes, data, and constants for the histogram module
+ *
+ *  Log-linear (HDR-style) histogram of 64-bit values: exact below
+ *  HIST_SUB, then HIST_SUB buckets per power of two, so any recorded
+ *  value is reported to within 1/HIST_SUB (about 3%).  Recording is an
+ *  index computation and one increment; histograms are per thread and
+ *  merged once the threads are done.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// HISTOGRAM
+
+typedef struct __hist_t {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  double sum;
+} hist_t;
+
+// Monotonic clock in nanoseconds, for the intervals recorded in histograms
+static inline uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// histogram methods
+hist_t * hist_new();
+void hist_init(hist_t *h);
+void hist_record(hist_t *h, uint64_t v);
+void hist_merge(hist_t *dst, const hist_t *src);
+uint64_t hist_percentile(const hist_t *h, double p);
+double hist_mean(const hist_t *h);
@@ -0,0 +1,363 @@
+/*
+ *  Matrix kernel routines
+ *
+ *  Three families of kernels:
+ *  - scalar reference loops, used on any CPU
+ *  - fully unrolled multiplies for every shape GenMatrixRandom() makes
+ *    in mode 0 (all dimensions 1..SMALL_DIM)
+ *  - SSE2 / AVX2 loops for larger matrices, picked at runtime from what
+ *    the CPU supports
+ *
+ *  Multiplies are done on unsigned ints so overflow wraps exactly as the
+ *  vector lanes do; the results therefore match the scalar loop bit for bit.
+ *  Sums widen every element to 64 bits before adding, so they are exact.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#else
+#define HAVE_X86 0
+#endif
+
+// Instruction set in use, one of KERNEL_SCALAR / SSE2 / AVX2
+static int kernel_isa = KERNEL_SCALAR;
+
+// SCALAR REFERENCE KERNELS
+
+// accumulate selects c = a*b (0) or c += a*b (1); it is a constant at every
+// call site, so each wrapper below compiles to its own specialised loop
+static inline __attribute__((always_inline))
+void mult_scalar_body(const int *a, int sa, const int *b, int sb,
+                      int *c, int sc, int r, int k, int n, int accumulate)
+{
+  for (int i = 0; i < r; i++)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      unsigned sum = accumulate ? (unsigned) c[(size_t) i * sc + j] : 0;
+      for (int x = 0; x < k; x++)
+        sum += (unsigned) a[(size_t) i * sa + x] * (unsigned) b[(size_t) x * sb + j];
+      c[(size_t) i * sc + j] = (int) sum;
+    }
+  }
+}
+
+void mult_scalar(const int *a, int sa, const int *b, int sb,
+                 int *c, int sc, int r, int k, int n)
+{
+  mult_scalar_body(a, sa, b, sb, c, sc, r, k, n, 0);
+}
+
+static void multacc_scalar(const int *a, int sa, const int *b, int sb,
+                           int *c, int sc, int r, int k, int n)
+{
+  mult_scalar_body(a, sa, b, sb, c, sc, r, k, n, 1);
+}
+
+long long sum_scalar(const int *a, int s, int r, int c)
+{
+  long long total = 0;
+  for (int i = 0; i < r; i++)
+  {
+    const int *row = a + (size_t) i * s;
+    for (int j = 0; j < c; j++)
+      total += row[j];
+  }
+  return total;
+}
+
+// FIXED-SIZE KERNELS
+// One function per (R, K, N) with constant trip counts, so the compiler
+// unrolls every loop and keeps the whole product in registers.
+
+#define SMALL_MULT(R, K, N)                                                   \
+static void mult_##R##x##K##x##N(const int *a, int sa, const int *b, int sb,  \
+                                 int *c, int sc, int r, int k, int n)         \
+{                                                                             \
+  _Pragma("GCC unroll 4")                                                     \
+  for (int i = 0; i < R; i++)                                                 \
+  {                                                                           \
+    _Pragma("GCC unroll 4")                                                   \
+    for (int j = 0; j < N; j++)                                               \
+    {                                                                         \
+      unsigned sum = 0;                                                       \
+      _Pragma("GCC unroll 4")                                                 \
+      for (int x = 0; x < K; x++)                                             \
+        sum += (unsigned) a[i * sa + x] * (unsigned) b[x * sb + j];           \
+      c[i * sc + j] = (int) sum;                                              \
+    }                                                                         \
+  }                                                                           \
+}
+
+#define SMALL_MULT_N(R, K) \
+  SMALL_MULT(R, K, 1) SMALL_MULT(R, K, 2) SMALL_MULT(R, K, 3) SMALL_MULT(R, K, 4)
+#define SMALL_MULT_K(R) \
+  SMALL_MULT_N(R, 1) SMALL_MULT_N(R, 2) SMALL_MULT_N(R, 3) SMALL_MULT_N(R, 4)
+
+SMALL_MULT_K(1)
+SMALL_MULT_K(2)
+SMALL_MULT_K(3)
+SMALL_MULT_K(4)
+
+#define SMALL_ROW_N(R, K) \
+  { mult_##R##x##K##x1, mult_##R##x##K##x2, mult_##R##x##K##x3, mult_##R##x##K##x4 }
+#define SMALL_ROW_K(R) \
+  { SMALL_ROW_N(R, 1), SMALL_ROW_N(R, 2), SMALL_ROW_N(R, 3), SMALL_ROW_N(R, 4) }
+
+// small_mult[r-1][k-1][n-1]
+static const mult_kernel_t small_mult[SMALL_DIM][SMALL_DIM][SMALL_DIM] = {
+  SMALL_ROW_K(1), SMALL_ROW_K(2), SMALL_ROW_K(3), SMALL_ROW_K(4)
+};
+
+#if HAVE_X86
+
+// SSE2 KERNELS
+
+// SSE2 has no 32-bit low multiply; build one from two 32x32->64 multiplies
+__attribute__((target("sse2")))
+static inline __m128i mullo_sse2(__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// For each row of a, accumulate 4 output columns at a time in a register
+__attribute__((target("sse2"), always_inline))
+static inline void mult_sse2_body(const int *a, int sa, const int *b, int sb,
+                                  int *c, int sc, int r, int k, int n, int accumulate)
+{
+  for (int i = 0; i < r; i++)
+  {
+    const int *arow = a + (size_t) i * sa;
+    int *crow = c + (size_t) i * sc;
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+      __m128i acc = accumulate ? _mm_loadu_si128((const __m128i *) (crow + j)) : _mm_setzero_si128();
+      for (int x = 0; x < k; x++)
+      {
+        __m128i av = _mm_set1_epi32(arow[x]);
+        __m128i bv = _mm_loadu_si128((const __m128i *) (b + (size_t) x * sb + j));
+        acc = _mm_add_epi32(acc, mullo_sse2(av, bv));
+      }
+      _mm_storeu_si128((__m128i *) (crow + j), acc);
+    }
+    for (; j < n; j++)
+    {
+      unsigned sum = accumulate ? (unsigned) crow[j] : 0;
+      for (int x = 0; x < k; x++)
+        sum += (unsigned) arow[x] * (unsigned) b[(size_t) x * sb + j];
+      crow[j] = (int) sum;
+    }
+  }
+}
+
+__attribute__((target("sse2")))
+static void mult_sse2(const int *a, int sa, const int *b, int sb,
+                      int *c, int sc, int r, int k, int n)
+{
+  mult_sse2_body(a, sa, b, sb, c, sc, r, k, n, 0);
+}
+
+__attribute__((target("sse2")))
+static void multacc_sse2(const int *a, int sa, const int *b, int sb,
+                         int *c, int sc, int r, int k, int n)
+{
+  mult_sse2_body(a, sa, b, sb, c, sc, r, k, n, 1);
+}
+
+__attribute__((target("sse2")))
+static long long sum_sse2(const int *a, int s, int r, int c)
+{
+  // Two 64-bit lanes per accumulator; SSE2 has no sign extension, so the
+  // sign words come from an arithmetic shift
+  __m128i acc_lo = _mm_setzero_si128();
+  __m128i acc_hi = _mm_setzero_si128();
+  long long total = 0;
+  for (int i = 0; i < r; i++)
+  {
+    const int *row = a + (size_t) i * s;
+    int j = 0;
+    for (; j + 4 <= c; j += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (row + j));
+      __m128i sign = _mm_srai_epi32(v, 31);
+      acc_lo = _mm_add_epi64(acc_lo, _mm_unpacklo_epi32(v, sign));
+      acc_hi = _mm_add_epi64(acc_hi, _mm_unpackhi_epi32(v, sign));
+    }
+    for (; j < c; j++)
+      total += row[j];
+  }
+  long long lanes[2];
+  _mm_storeu_si128((__m128i *) lanes, _mm_add_epi64(acc_lo, acc_hi));
+  return total + lanes[0] + lanes[1];
+}
+
+// AVX2 KERNELS
+
+__attribute__((target("avx2"), always_inline))
+static inline void mult_avx2_body(const int *a, int sa, const int *b, int sb,
+                                  int *c, int sc, int r, int k, int n, int accumulate)
+{
+  for (int i = 0; i < r; i++)
+  {
+    const int *arow = a + (size_t) i * sa;
+    int *crow = c + (size_t) i * sc;
+    int j = 0;
+    // Two accumulators per step to hide the multiply latency
+    for (; j + 16 <= n; j += 16)
+    {
+      __m256i acc0 = accumulate ? _mm256_loadu_si256((const __m256i *) (crow + j)) : _mm256_setzero_si256();
+      __m256i acc1 = accumulate ? _mm256_loadu_si256((const __m256i *) (crow + j + 8)) : _mm256_setzero_si256();
+      for (int x = 0; x < k; x++)
+      {
+        __m256i av = _mm256_set1_epi32(arow[x]);
+        const int *brow = b + (size_t) x * sb + j;
+        acc0 = _mm256_add_epi32(acc0, _mm256_mullo_epi32(av, _mm256_loadu_si256((const __m256i *) brow)));
+        acc1 = _mm256_add_epi32(acc1, _mm256_mullo_epi32(av, _mm256_loadu_si256((const __m256i *) (brow + 8))));
+      }
+      _mm256_storeu_si256((__m256i *) (crow + j), acc0);
+      _mm256_storeu_si256((__m256i *) (crow + j + 8), acc1);
+    }
+    for (; j + 8 <= n; j += 8)
+    {
+      __m256i acc0 = accumulate ? _mm256_loadu_si256((const __m256i *) (crow + j)) : _mm256_setzero_si256();
+      for (int x = 0; x < k; x++)
+      {
+        __m256i av = _mm256_set1_epi32(arow[x]);
+        __m256i bv = _mm256_loadu_si256((const __m256i *) (b + (size_t) x * sb + j));
+        acc0 = _mm256_add_epi32(acc0, _mm256_mullo_epi32(av, bv));
+      }
+      _mm256_storeu_si256((__m256i *) (crow + j), acc0);
+    }
+    for (; j < n; j++)
+    {
+      unsigned sum = accumulate ? (unsigned) crow[j] : 0;
+      for (int x = 0; x < k; x++)
+        sum += (unsigned) arow[x] * (unsigned) b[(size_t) x * sb + j];
+      crow[j] = (int) sum;
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+static void mult_avx2(const int *a, int sa, const int *b, int sb,
+                      int *c, int sc, int r, int k, int n)
+{
+  mult_avx2_body(a, sa, b, sb, c, sc, r, k, n, 0);
+}
+
+__attribute__((target("avx2")))
+static void multacc_avx2(const int *a, int sa, const int *b, int sb,
+                         int *c, int sc, int r, int k, int n)
+{
+  mult_avx2_body(a, sa, b, sb, c, sc, r, k, n, 1);
+}
+
+__attribute__((target("avx2")))
+static long long sum_avx2(const int *a, int s, int r, int c)
+{
+  __m256i acc_lo = _mm256_setzero_si256();
+  __m256i acc_hi = _mm256_setzero_si256();
+  long long total = 0;
+  for (int i = 0; i < r; i++)
+  {
+    const int *row = a + (size_t) i * s;
+    int j = 0;
+    for (; j + 8 <= c; j += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (row + j));
+      acc_lo = _mm256_add_epi64(acc_lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+      acc_hi = _mm256_add_epi64(acc_hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    for (; j < c; j++)
+      total += row[j];
+  }
+  long long lanes[4];
+  _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc_lo, acc_hi));
+  return total + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+#endif
+
+// KERNEL DISPATCH
+
+// Pick the instruction set: KERNEL_AUTO takes the best the CPU has.
+// Returns -1 if a specific instruction set was asked for but is missing.
+int kernels_init(int isa)
+{
+#if HAVE_X86
+  __builtin_cpu_init();
+  int best = __builtin_cpu_supports("avx2") ? KERNEL_AVX2 :
+             __builtin_cpu_supports("sse2") ? KERNEL_SSE2 : KERNEL_SCALAR;
+#else
+  int best = KERNEL_SCALAR;
+#endif
+  if (isa == KERNEL_AUTO)
+    isa = best;
+  if (isa > best)
+    return -1;
+  kernel_isa = isa;
+  return 0;
+}
+
+const char * kernels_name()
+{
+  switch (kernel_isa)
+  {
+    case KERNEL_AVX2:
+      return "avx2";
+    case KERNEL_SSE2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+mult_kernel_t select_mult_kernel(int r, int k, int n)
+{
+  if (kernel_isa == KERNEL_SCALAR)
+    return mult_scalar;
+  if (r <= SMALL_DIM && k <= SMALL_DIM && n <= SMALL_DIM && r > 0 && k > 0 && n > 0)
+    return small_mult[r - 1][k - 1][n - 1];
+#if HAVE_X86
+  if (kernel_isa >= KERNEL_AVX2 && n >= 8)
+    return mult_avx2;
+  if (n >= 4)
+    return mult_sse2;
+#endif
+  return mult_scalar;
+}
+
+// Accumulating kernel (c += a*b) for building a product block by block
+mult_kernel_t select_multacc_kernel(int n)
+{
+#if HAVE_X86
+  if (kernel_isa >= KERNEL_AVX2 && n >= 8)
+    return multacc_avx2;
+  if (kernel_isa >= KERNEL_SSE2 && n >= 4)
+    return multacc_sse2;
+#endif
+  return multacc_scalar;
+}
+
+sum_kernel_t select_sum_kernel(int r, int c)
+{
+#if HAVE_X86
+  if (kernel_isa >= KERNEL_AVX2 && c >= 8)
+    return sum_avx2;
+  if (kernel_isa >= KERNEL_SSE2 && c >= 4)
+    return sum_sse2;
+#endif
+  return sum_scalar;
+}
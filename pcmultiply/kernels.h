@@ -0,0 +1,39 @@
+/*
+ *  kernels header
+ *  Function prototypes, data, and constants for the matrix kernel module
+ *
+ *  Inner loops behind MatrixMultiply() and SumMatrix().  Every kernel
+ *  works on raw row-major element pointers plus strides.  Multiplies
+ *  compute in wrapping 32-bit arithmetic and sums in exact 64-bit
+ *  arithmetic, so all of them return bit-identical results regardless
+ *  of instruction set or summation order.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Largest dimension with a fully unrolled multiply kernel
+#define SMALL_DIM 4
+
+// Instruction set selection for the vector kernels
+#define KERNEL_AUTO 0
+#define KERNEL_SCALAR 1
+#define KERNEL_SSE2 2
+#define KERNEL_AVX2 3
+
+// c (r x n) = a (r x k) * b (k x n); sa, sb, sc are row strides in elements
+typedef void (*mult_kernel_t)(const int *a, int sa, const int *b, int sb,
+                              int *c, int sc, int r, int k, int n);
+
+// sum of an r x c block with row stride s
+typedef long long (*sum_kernel_t)(const int *a, int s, int r, int c);
+
+// kernel methods
+int kernels_init(int isa);
+const char * kernels_name();
+mult_kernel_t select_mult_kernel(int r, int k, int n);
+mult_kernel_t select_multacc_kernel(int n);
+sum_kernel_t select_sum_kernel(int r, int c);
+void mult_scalar(const int *a, int sa, const int *b, int sb,
+                 int *c, int sc, int r, int k, int n);
+long long sum_scalar(const int *a, int s, int r, int c);
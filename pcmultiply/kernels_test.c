@@ -0,0 +1,157 @@
+/*
+ *  kernels_test
+ *  Differential test of the matrix kernels
+ *
+ *    kernels_test
+ *
+ *  Under every instruction set the CPU supports, each kernel that
+ *  select_mult_kernel(), select_multacc_kernel() and select_sum_kernel()
+ *  can return - the scalar loops, the unrolled 1..4 kernels, SSE2 and
+ *  AVX2 - is run on full-range random ints and compared with a plain
+ *  triple loop (multiplies, modulo 2^32) or a 64-bit sum.  Widths cover
+ *  every vector loop tail, and every row stride is padded past the width,
+ *  so a kernel that assumes contiguous rows or writes past a row fails.
+ *
+ *  Prints one line per instruction set; exits with status 1 at the first
+ *  mismatch.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "kernels.h"
+#include "rng.h"
+
+// Padding value checked after every multiply
+#define GUARD ((int) 0x5a5a5a5a)
+
+static const int rk_dims[] = { 1, 2, 3, 4, 5, 7, 9, 16, 17 };
+static const int n_dims[] = { 1, 2, 3, 4, 5, 7, 8, 9, 12, 15, 16, 17, 24, 25, 31, 33 };
+#define RK_DIMS ((int) (sizeof(rk_dims) / sizeof(rk_dims[0])))
+#define N_DIMS ((int) (sizeof(n_dims) / sizeof(n_dims[0])))
+
+static const char * isa_names[] = { "auto", "scalar", "sse2", "avx2" };
+
+static rng_t rng;
+
+static void fill(int *m, int rows, int stride)
+{
+  for (int i = 0; i < rows * stride; i++)
+    m[i] = (int) rng_next(&rng);
+}
+
+// Row stride for a row of width elements: always padded, by 1 to 3
+static int stride_for(int width)
+{
+  return width + 1 + (width % 3);
+}
+
+// c (r x n) = c0 + a * b modulo 2^32, the way the kernels must compute it
+static void reference(const int *a, int sa, const int *b, int sb, const int *c0,
+                      int *c, int sc, int r, int k, int n)
+{
+  for (int i = 0; i < r; i++)
+    for (int j = 0; j < n; j++)
+    {
+      unsigned sum = (c0 != NULL) ? (unsigned) c0[i * sc + j] : 0;
+      for (int x = 0; x < k; x++)
+        sum += (unsigned) a[i * sa + x] * (unsigned) b[x * sb + j];
+      c[i * sc + j] = (int) sum;
+    }
+}
+
+// Run kernel on one r x k x n shape; nonzero if it differs from the reference
+static int check_mult(const char *what, mult_kernel_t kernel, int accumulate, int r, int k, int n)
+{
+  int sa = stride_for(k), sb = stride_for(n), sc = stride_for(n);
+  int *a = malloc(sizeof(int) * r * sa);
+  int *b = malloc(sizeof(int) * k * sb);
+  int *c = malloc(sizeof(int) * r * sc);
+  int *c0 = malloc(sizeof(int) * r * sc);
+  int *want = malloc(sizeof(int) * r * sc);
+  fill(a, r, sa);
+  fill(b, k, sb);
+  fill(c0, r, sc);
+  for (int i = 0; i < r; i++)
+    for (int j = n; j < sc; j++)
+      c0[i * sc + j] = GUARD;
+  for (int i = 0; i < r * sc; i++)
+    c[i] = want[i] = c0[i];
+
+  kernel(a, sa, b, sb, c, sc, r, k, n);
+  reference(a, sa, b, sb, accumulate ? c0 : NULL, want, sc, r, k, n);
+
+  int bad = 0;
+  for (int i = 0; i < r * sc && !bad; i++)
+    if (c[i] != want[i])
+    {
+      fprintf(stderr, "kernels_test: %s %dx%dx%d differs at row %d col %d: %d, expected %d\n",
+              what, r, k, n, i / sc, i % sc, c[i], want[i]);
+      bad = 1;
+    }
+  free(a);
+  free(b);
+  free(c);
+  free(c0);
+  free(want);
+  return bad;
+}
+
+// Run the sum kernel for an r x c block; nonzero if it is not the exact sum
+static int check_sum(int r, int c)
+{
+  int s = stride_for(c);
+  int *a = malloc(sizeof(int) * r * s);
+  fill(a, r, s);
+  long long want = 0;
+  for (int i = 0; i < r; i++)
+    for (int j = 0; j < c; j++)
+      want += a[i * s + j];
+  long long got = select_sum_kernel(r, c)(a, s, r, c);
+  free(a);
+  if (got != want)
+  {
+    fprintf(stderr, "kernels_test: sum %dx%d is %lld, expected %lld\n", r, c, got, want);
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  rng_seed(&rng, 422, 0);
+  for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX2; isa++)
+  {
+    if (kernels_init(isa) != 0)
+    {
+      printf("kernels_test: %-6s skipped, not supported by this CPU\n", isa_names[isa]);
+      continue;
+    }
+    int products = 0, sums = 0;
+    for (int x = 0; x < RK_DIMS; x++)
+      for (int y = 0; y < RK_DIMS; y++)
+        for (int z = 0; z < N_DIMS; z++)
+        {
+          int r = rk_dims[x], k = rk_dims[y], n = n_dims[z];
+          if (check_mult("mult", select_mult_kernel(r, k, n), 0, r, k, n) ||
+              check_mult("multacc", select_multacc_kernel(n), 1, r, k, n))
+            return 1;
+          products += 2;
+        }
+    for (int r = 1; r <= 40; r += 3)
+      for (int c = 1; c <= 40; c++)
+      {
+        if (check_sum(r, c))
+          return 1;
+        sums++;
+      }
+    // sums far beyond 32 bits
+    if (check_sum(1000, 1000))
+      return 1;
+    sums++;
+    printf("kernels_test: %-6s ok, %d products and %d sums match\n", kernels_name(), products, sums);
+  }
+  return 0;
+}
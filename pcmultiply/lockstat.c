@@ -0,0 +1,219 @@
+/*
+ *  Contention statistics routines
+ *
+ *  A thread's lockstat_t is allocated the first time it records anything
+ *  and linked onto a global list, the only step that takes a lock.  The
+ *  list is walked by lockstat_print() after every worker has been joined.
+ *
+ *  A wait loop looks like
+ *
+ *    while (full)
+ *      STAT_COND_WAIT(&not_full, &buffer_mutex, STAT_NOT_FULL, STAT_BUFFER_MUTEX);
+ *    STAT_WAIT_DONE(STAT_NOT_FULL);
+ *
+ *  Blocked time is only clocked once a call actually waits; a call that
+ *  finds room (or a matrix) just counts itself.  A wakeup is useful when
+ *  the loop exits right after it; the others are spurious or stolen.
+ *
+ *  Under --wait=futex the same loop calls waitq_wait() between
+ *  STAT_WAIT_BEGIN and STAT_WAIT_END, which account for it the same way.
+ *
+ *  The other buffer engines do no waiting here, so under them only
+ *  stdout_mutex (--display=sync) is reported.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include "hist.h"
+#include "lockstat.h"
+
+static const char * lock_names[STAT_LOCKS] = { "buffer_mutex", "stdout_mutex" };
+static const char * cond_names[STAT_CONDS] = { "not_full", "not_empty" };
+
+static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lockstat_t * all_stats = NULL;
+static __thread lockstat_t * mine = NULL;
+
+static lockstat_t * thread_stats()
+{
+  if (mine != NULL)
+    return mine;
+  lockstat_t *s = (lockstat_t *) calloc(1, sizeof(lockstat_t));
+  if (s == NULL)
+  {
+    perror("lockstat");
+    exit(1);
+  }
+  for (int i = 0; i < STAT_LOCKS; i++)
+  {
+    hist_init(&s->acquire[i]);
+    hist_init(&s->hold[i]);
+  }
+  for (int i = 0; i < STAT_CONDS; i++)
+    hist_init(&s->blocked[i]);
+  hist_init(&s->occupancy);
+
+  pthread_mutex_lock(&list_mutex);
+  s->next = all_stats;
+  all_stats = s;
+  pthread_mutex_unlock(&list_mutex);
+  mine = s;
+  return s;
+}
+
+int stat_lock(pthread_mutex_t *m, int lock)
+{
+  lockstat_t *s = thread_stats();
+  uint64_t t0 = now_ns();
+  int rc = pthread_mutex_lock(m);
+  uint64_t t1 = now_ns();
+  hist_record(&s->acquire[lock], t1 - t0);
+  s->held_since[lock] = t1;
+  return rc;
+}
+
+int stat_unlock(pthread_mutex_t *m, int lock)
+{
+  lockstat_t *s = thread_stats();
+  hist_record(&s->hold[lock], now_ns() - s->held_since[lock]);
+  return pthread_mutex_unlock(m);
+}
+
+// Bracket a wait that releases and retakes lock (pthread_cond_wait(),
+// waitq_wait()); the time in between is not counted as held
+void stat_wait_begin(int cond, int lock)
+{
+  lockstat_t *s = thread_stats();
+  uint64_t t0 = now_ns();
+  hist_record(&s->hold[lock], t0 - s->held_since[lock]);
+  if (s->wait_start[cond] == 0)
+    s->wait_start[cond] = t0;
+}
+
+void stat_wait_end(int cond, int lock)
+{
+  lockstat_t *s = thread_stats();
+  s->held_since[lock] = now_ns();
+  s->wakeups[cond]++;
+}
+
+// pthread_cond_wait() on lock m
+int stat_cond_wait(pthread_cond_t *c, pthread_mutex_t *m, int cond, int lock)
+{
+  stat_wait_begin(cond, lock);
+  int rc = pthread_cond_wait(c, m);
+  stat_wait_end(cond, lock);
+  return rc;
+}
+
+// The wait loop for cond has exited; records the time blocked, if any
+void stat_wait_done(int cond)
+{
+  lockstat_t *s = thread_stats();
+  s->calls[cond]++;
+  if (s->wait_start[cond] != 0)
+  {
+    hist_record(&s->blocked[cond], now_ns() - s->wait_start[cond]);
+    s->waits[cond]++;
+    s->wait_start[cond] = 0;
+  }
+}
+
+void stat_occupancy(int n)
+{
+  hist_record(&thread_stats()->occupancy, (uint64_t) n);
+}
+
+static void print_hist(FILE *f, const char *name, const char *what, hist_t *h)
+{
+  fprintf(f, "  %-22s %-8s %10llu %10.0f %10llu %10llu %10llu\n", name, what,
+          (unsigned long long) h->total, hist_mean(h),
+          (unsigned long long) hist_percentile(h, 50.0),
+          (unsigned long long) hist_percentile(h, 99.0),
+          (unsigned long long) (h->total ? h->max : 0));
+}
+
+// Merge every thread's statistics and print a summary; capacity is the
+// bounded buffer size, for reading the occupancy figures
+void lockstat_print(FILE *f, int capacity)
+{
+  lockstat_t *total = (lockstat_t *) calloc(1, sizeof(lockstat_t));
+  if (total == NULL)
+    return;
+  for (int i = 0; i < STAT_LOCKS; i++)
+  {
+    hist_init(&total->acquire[i]);
+    hist_init(&total->hold[i]);
+  }
+  for (int i = 0; i < STAT_CONDS; i++)
+    hist_init(&total->blocked[i]);
+  hist_init(&total->occupancy);
+
+  pthread_mutex_lock(&list_mutex);
+  for (lockstat_t *s = all_stats; s != NULL; s = s->next)
+  {
+    for (int i = 0; i < STAT_LOCKS; i++)
+    {
+      hist_merge(&total->acquire[i], &s->acquire[i]);
+      hist_merge(&total->hold[i], &s->hold[i]);
+    }
+    for (int i = 0; i < STAT_CONDS; i++)
+    {
+      hist_merge(&total->blocked[i], &s->blocked[i]);
+      total->calls[i] += s->calls[i];
+      total->waits[i] += s->waits[i];
+      total->wakeups[i] += s->wakeups[i];
+    }
+    hist_merge(&total->occupancy, &s->occupancy);
+  }
+  pthread_mutex_unlock(&list_mutex);
+
+  fprintf(f, "Contention (ns):                    count       mean        p50        p99        max\n");
+  for (int i = 0; i < STAT_LOCKS; i++)
+  {
+    if (total->acquire[i].total == 0)
+      continue;
+    print_hist(f, lock_names[i], "acquire", &total->acquire[i]);
+    print_hist(f, lock_names[i], "hold", &total->hold[i]);
+  }
+  for (int i = 0; i < STAT_CONDS; i++)
+    if (total->calls[i] > 0)
+      print_hist(f, cond_names[i], "blocked", &total->blocked[i]);
+  for (int i = 0; i < STAT_CONDS; i++)
+  {
+    if (total->calls[i] == 0)
+      continue;
+    uint64_t useful = total->waits[i];
+    fprintf(f, "  %-22s %llu of %llu calls waited, %llu wakeups, %llu useful (%.1f%%)\n",
+            cond_names[i], (unsigned long long) total->waits[i],
+            (unsigned long long) total->calls[i], (unsigned long long) total->wakeups[i],
+            (unsigned long long) useful,
+            total->wakeups[i] ? 100.0 * (double) useful / (double) total->wakeups[i] : 100.0);
+  }
+  if (total->occupancy.total > 0)
+    fprintf(f, "  buffer occupancy       mean %.1f  p50 %llu  p99 %llu  max %llu  of %d  (%llu samples)\n",
+            hist_mean(&total->occupancy),
+            (unsigned long long) hist_percentile(&total->occupancy, 50.0),
+            (unsigned long long) hist_percentile(&total->occupancy, 99.0),
+            (unsigned long long) total->occupancy.max, capacity,
+            (unsigned long long) total->occupancy.total);
+  free(total);
+}
+
+// Free every thread's statistics; no thread may record afterwards
+void lockstat_shutdown()
+{
+  pthread_mutex_lock(&list_mutex);
+  while (all_stats != NULL)
+  {
+    lockstat_t *s = all_stats;
+    all_stats = s->next;
+    free(s);
+  }
+  pthread_mutex_unlock(&list_mutex);
+  mine = NULL;
+}
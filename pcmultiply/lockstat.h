@@ -0,0 +1,80 @@
+/*
+ *  lockstat header
+ *  Function prototypes, data, and constants for the contention statistics module
+ *
+ *  Each thread keeps its own histograms of lock acquire and hold times,
+ *  time blocked on the buffer's condition variables and buffer occupancy,
+ *  so recording never touches shared state.  main() merges and prints
+ *  them once the workers have exited.
+ *
+ *  Built in when PC_STATS is defined (make STATS=1, the default) and
+ *  recorded only when LOCK_STATS is set at run time (--stats).  With
+ *  PC_STATS undefined the STAT_* macros are the plain pthread calls.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+// Instrumented locks
+#define STAT_BUFFER_MUTEX 0
+#define STAT_STDOUT_MUTEX 1
+#define STAT_LOCKS 2
+
+// Instrumented condition variables
+#define STAT_NOT_FULL 0
+#define STAT_NOT_EMPTY 1
+#define STAT_CONDS 2
+
+// CONTENTION STATISTICS
+
+typedef struct __lockstat_t {
+  hist_t acquire[STAT_LOCKS];     // ns from lock() to owning the lock
+  hist_t hold[STAT_LOCKS];        // ns owned, excluding time inside cond_wait()
+  hist_t blocked[STAT_CONDS];     // ns per call that had to wait
+  hist_t occupancy;               // matrices in the buffer at each put/get
+  uint64_t calls[STAT_CONDS];     // put/get calls that checked the condition
+  uint64_t waits[STAT_CONDS];     // calls that had to wait at least once
+  uint64_t wakeups[STAT_CONDS];   // returns from cond_wait()
+  uint64_t held_since[STAT_LOCKS];
+  uint64_t wait_start[STAT_CONDS];
+  struct __lockstat_t * next;
+} lockstat_t;
+
+#ifdef PC_STATS
+#define STAT_LOCK(m, lock) \
+  (LOCK_STATS ? stat_lock(m, lock) : pthread_mutex_lock(m))
+#define STAT_UNLOCK(m, lock) \
+  (LOCK_STATS ? stat_unlock(m, lock) : pthread_mutex_unlock(m))
+#define STAT_COND_WAIT(c, m, cond, lock) \
+  (LOCK_STATS ? stat_cond_wait(c, m, cond, lock) : pthread_cond_wait(c, m))
+#define STAT_WAIT_BEGIN(cond, lock) \
+  do { if (LOCK_STATS) stat_wait_begin(cond, lock); } while (0)
+#define STAT_WAIT_END(cond, lock) \
+  do { if (LOCK_STATS) stat_wait_end(cond, lock); } while (0)
+#define STAT_WAIT_DONE(cond) \
+  do { if (LOCK_STATS) stat_wait_done(cond); } while (0)
+#define STAT_OCCUPANCY(n) \
+  do { if (LOCK_STATS) stat_occupancy(n); } while (0)
+#else
+#define STAT_LOCK(m, lock) pthread_mutex_lock(m)
+#define STAT_UNLOCK(m, lock) pthread_mutex_unlock(m)
+#define STAT_COND_WAIT(c, m, cond, lock) pthread_cond_wait(c, m)
+#define STAT_WAIT_BEGIN(cond, lock) do { } while (0)
+#define STAT_WAIT_END(cond, lock) do { } while (0)
+#define STAT_WAIT_DONE(cond) do { } while (0)
+#define STAT_OCCUPANCY(n) do { } while (0)
+#endif
+
+// lockstat methods
+int stat_lock(pthread_mutex_t *m, int lock);
+int stat_unlock(pthread_mutex_t *m, int lock);
+int stat_cond_wait(pthread_cond_t *c, pthread_mutex_t *m, int cond, int lock);
+void stat_wait_begin(int cond, int lock);
+void stat_wait_end(int cond, int lock);
+void stat_wait_done(int cond);
+void stat_occupancy(int n);
+void lockstat_print(FILE *f, int capacity);
+void lockstat_shutdown();
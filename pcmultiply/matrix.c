@@ -16,63 +16,117 @@
 #include <string.h>
 #include <time.h>
 #include "matrix.h"
+#include "elem.h"
+#include "pool.h"
+#include "kernels.h"
+#include "rng.h"
+#include "blockmult.h"
+#include "strassen.h"
+#include "sparse.h"
 #include "pcmatrix.h"
 
 
+// Header size rounded up so the elements start on a cache line
+#define MATRIX_HEADER (((sizeof(Matrix) + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN)
+
 // MATRIX ROUTINES
+
+// Allocate directly from malloc, bypassing the matrix pool
+Matrix * NewMatrixElem(int r, int c, int elem)
+{
+  Matrix * mat;
+  size_t bytes = MATRIX_HEADER + (size_t) elem_sizes[elem] * r * c;
+  // aligned_alloc wants a multiple of the alignment
+  bytes = ((bytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN;
+  mat = (Matrix *) aligned_alloc(MATRIX_ALIGN, bytes);
+  assert(mat != 0);
+  mat->data = (int *) ((char *) mat + MATRIX_HEADER);
+  mat->rows=r;
+  mat->cols=c;
+  mat->stride=c;
+  mat->elem=elem;
+  mat->nnz=MATRIX_DENSE;
+  mat->pool=NULL;
+  mat->next=NULL;
+  return mat;
+}
+
+Matrix * NewMatrix(int r, int c)
+{
+  return NewMatrixElem(r, c, ELEM_I32);
+}
+
+Matrix * AllocMatrixElem(int r, int c, int elem)
+{
+  if (MATRIX_POOL)
+    return pool_alloc(r, c, elem);
+  return NewMatrixElem(r, c, elem);
+}
+
 Matrix * AllocMatrix(int r, int c)
+{
+  return AllocMatrixElem(r, c, ELEM_I32);
+}
+
+// Allocate an int CSR matrix with room for nnz elements (see sparse.h);
+// these never come from the pool
+Matrix * NewSparseMatrix(int r, int c, int nnz)
 {
   Matrix * mat;
-  mat = (Matrix *) malloc(sizeof(Matrix));
-  int ** a;
-  int i;
-  a = (int**) malloc(sizeof(int *) * r);
-  assert(a != 0);
-  for (i = 0; i < r; i++)
-  {
-    a[i] = (int *) malloc(c * sizeof(int));
-    assert(a[i] != 0);
-  }
-  mat->m=a;
+  size_t bytes = MATRIX_HEADER + sizeof(int) * (2 * (size_t) nnz + r + 1);
+  bytes = ((bytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN;
+  mat = (Matrix *) aligned_alloc(MATRIX_ALIGN, bytes);
+  assert(mat != 0);
+  mat->data = (int *) ((char *) mat + MATRIX_HEADER);
   mat->rows=r;
   mat->cols=c;
+  mat->stride=c;
+  mat->elem=ELEM_I32;
+  mat->nnz=nnz;
+  mat->pool=NULL;
+  mat->next=NULL;
   return mat;
 }
 
 void FreeMatrix(Matrix * mat)
 {
-  int r = mat->rows;
-  //int c = mat->cols;
-  int **a = mat->m;
-  int i;
-  for (i=0; i<r; i++)
-  {
-    free(a[i]);
-  }
-  free(a);
-  free(mat);
+  // Pooled matrices go back to the pool that allocated them
+  if (mat->pool != NULL)
+    pool_free(mat);
+  else
+    free(mat);
 }
 
 void GenMatrix(Matrix * mat)
 {
   int height = mat->rows;
   int width = mat->cols;
-  int ** a = mat->m;
+  rng_t * rng = rng_thread();
+  long long sum = 0;
   int i, j;
+  if (mat->elem != ELEM_I32)
+  {
+    elem_gen(mat);
+    return;
+  }
+  // The sum is taken while the elements are written, so nobody has to
+  // read the matrix again to count it
   for (i = 0; i < height; i++)
   {
+    int * mm = MATRIX_ROW(mat, i);
     for (j = 0; j < width; j++)
     {
-      int * mm = a[i];
       if (MATRIX_MODE == 0)
-        mm[j] = 1 + rand() % 10;
+        mm[j] = 1 + rng_range(rng, 10);
       else
         mm[j] = 1;
+      sum += mm[j];
 #if OUTPUT
       printf("matrix[%d][%d]=%d \n",i,j,mm[j]);
 #endif
     }
   }
+  mat->sum = sum;
 }
 
 Matrix * GenMatrixRandom()
@@ -81,15 +135,18 @@ Matrix * GenMatrixRandom()
   int col;
   if (MATRIX_MODE ==0)
   {
-    row = 1 + rand() % 4;
-    col = 1 + rand() % 4;
+    rng_t * rng = rng_thread();
+    row = 1 + rng_range(rng, 4);
+    col = 1 + rng_range(rng, 4);
   }
   else
   {
     row = MATRIX_MODE;
     col = MATRIX_MODE;
   }
-  Matrix * mat = AllocMatrix(row, col);
+  if (DENSITY > 0 && DENSITY < 1)
+    return sparse_gen(row, col);
+  Matrix * mat = AllocMatrixElem(row, col, ELEM_TYPE);
   GenMatrix(mat);
   return mat;
 }
@@ -97,7 +154,9 @@ Matrix * GenMatrixRandom()
 Matrix * GenMatrixBySize(int row, int col)
 {
   printf("Generate random matrix (RxC) = (%dx%d)\n",row,col);
-  Matrix * mat = AllocMatrix(row, col);
+  if (DENSITY > 0 && DENSITY < 1)
+    return sparse_gen(row, col);
+  Matrix * mat = AllocMatrixElem(row, col, ELEM_TYPE);
   GenMatrix(mat);
   return mat;
 }
@@ -106,46 +165,74 @@ Matrix * MatrixMultiply(Matrix * m1, Matrix * m2)
 {
   if ((m1==NULL) || (m2==NULL))
     printf("m1=%p  m2=%p!\n",m1,m2);
-  int sum=0;
   if (m1->cols != m2->rows)
   {
     return NULL;
   }
   //printf("MULTIPLY (%d x %d) BY (%d x %d):\n",m1->rows,m1->cols,m2->rows,m2->cols);
-  Matrix * newmat = AllocMatrix(m1->rows, m2->cols);
-  int ** nm = newmat->m;
-  int ** ma1 = m1->m;
-  int ** ma2 = m2->m;
-  for (int c=0;c<newmat->rows;c++)
+  if (m1->elem != m2->elem)
+    return NULL;
+  if (m1->elem != ELEM_I32)
   {
-    for (int d=0;d<newmat->cols;d++)
+    Matrix * product = AllocMatrixElem(m1->rows, m2->cols, elem_products[m1->elem]);
+    if (elem_multiply(m1, m2, product) != 0)
     {
-      for (int k=0;k<m2->rows;k++)
-      {
-        sum = sum + ma1[c][k]*ma2[k][d];
-      }
-      nm[c][d] = sum;
-      sum=0;
+      FreeMatrix(product);
+      return NULL;
     }
+    return product;
+  }
+  if (MATRIX_IS_SPARSE(m1) || MATRIX_IS_SPARSE(m2))
+    return sparse_multiply(m1, m2);
+  Matrix * newmat = AllocMatrix(m1->rows, m2->cols);
+  // Large square products: fewer multiplies with Strassen-Winograd, which
+  // falls back to the paths below only if it cannot get its temporaries
+  if (STRASSEN_THRESHOLD > 0 && m1->rows >= STRASSEN_THRESHOLD &&
+      m1->rows == m1->cols && m2->rows == m2->cols &&
+      strassen_multiply(m1, m2, newmat) == 0)
+    return newmat;
+  if (m1->rows >= PARALLEL_THRESHOLD || m1->cols >= PARALLEL_THRESHOLD ||
+      m2->cols >= PARALLEL_THRESHOLD)
+  {
+    blocked_multiply(m1, m2, newmat);
+    return newmat;
   }
+  // Kernel chosen by shape: unrolled for small sizes, SIMD for wide rows
+  mult_kernel_t kernel = select_mult_kernel(m1->rows, m1->cols, m2->cols);
+  kernel(m1->data, m1->stride, m2->data, m2->stride,
+         newmat->data, newmat->stride, m1->rows, m1->cols, m2->cols);
   return newmat;
 }
 
 void DisplayMatrix(Matrix * mat, FILE *stream)
 {
-  if ((mat == NULL) || (mat->m == NULL))
+  if ((mat == NULL) || (mat->data == NULL))
   {
     printf("DisplayMatrix: EMPTY matrix\n");
     return;
   }
-  int ** matrix = mat->m;
+  if (MATRIX_IS_SPARSE(mat))
+  {
+    Matrix * dense = sparse_to_dense(mat);
+    DisplayMatrix(dense, stream);
+    FreeMatrix(dense);
+    return;
+  }
+  if (mat->elem != ELEM_I32)
+  {
+    char * text = (char *) malloc(elem_format_size(mat));
+    assert(text != 0);
+    fwrite(text, 1, elem_format(mat, text), stream);
+    free(text);
+    return;
+  }
   int height = mat->rows;
   int width = mat->cols;
   int y=0;
   int i, j;
   for (i=0; i<height; i++)
   {
-    int *mm = matrix[i];
+    int *mm = MATRIX_ROW(mat, i);
     fprintf(stream, "|");
     for (j=0; j<width; j++)
     {
@@ -159,10 +246,91 @@ void DisplayMatrix(Matrix * mat, FILE *stream)
   }
 }
 
+// Digit pairs "00".."99" for the integer formatter
+static const char digit_pairs[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// Write v as printf("%3d") would, returning the end of the text
+static char * format_int3(char * p, int v)
+{
+  char tmp[12];
+  char * t = tmp + sizeof(tmp);
+  unsigned u = (v < 0) ? 0u - (unsigned) v : (unsigned) v;
+  while (u >= 100)
+  {
+    unsigned q = u / 100;
+    t -= 2;
+    memcpy(t, digit_pairs + 2 * (u - q * 100), 2);
+    u = q;
+  }
+  if (u >= 10)
+  {
+    t -= 2;
+    memcpy(t, digit_pairs + 2 * u, 2);
+  }
+  else
+    *--t = (char) ('0' + u);
+  if (v < 0)
+    *--t = '-';
+
+  int len = (int) (tmp + sizeof(tmp) - t);
+  for (; len < 3; len++)
+    *p++ = ' ';
+  memcpy(p, t, tmp + sizeof(tmp) - t);
+  return p + (tmp + sizeof(tmp) - t);
+}
+
+// Upper bound on the bytes FormatMatrix() writes for mat
+size_t FormatMatrixSize(Matrix * mat)
+{
+  if ((mat == NULL) || (mat->data == NULL))
+    return 32;
+  if (mat->elem != ELEM_I32)
+    return elem_format_size(mat);
+  // per row: "|" + cols * (" " + up to 11 chars) + "|\n"
+  return (size_t) mat->rows * (3 + (size_t) mat->cols * 12);
+}
+
+// Render mat exactly as DisplayMatrix() prints it, into buf (which has at
+// least FormatMatrixSize(mat) bytes).  Returns the number of bytes written.
+size_t FormatMatrix(Matrix * mat, char * buf)
+{
+  static const char empty[] = "DisplayMatrix: EMPTY matrix\n";
+  if ((mat == NULL) || (mat->data == NULL))
+  {
+    memcpy(buf, empty, sizeof(empty) - 1);
+    return sizeof(empty) - 1;
+  }
+  if (MATRIX_IS_SPARSE(mat))
+  {
+    Matrix * dense = sparse_to_dense(mat);
+    size_t len = FormatMatrix(dense, buf);
+    FreeMatrix(dense);
+    return len;
+  }
+  if (mat->elem != ELEM_I32)
+    return elem_format(mat, buf);
+  char * p = buf;
+  for (int i = 0; i < mat->rows; i++)
+  {
+    int *mm = MATRIX_ROW(mat, i);
+    *p++ = '|';
+    for (int j = 0; j < mat->cols; j++)
+    {
+      if (j != 0)
+        *p++ = ' ';
+      p = format_int3(p, mm[j]);
+    }
+    *p++ = '|';
+    *p++ = '\n';
+  }
+  return (size_t) (p - buf);
+}
 
 int AvgElement(Matrix * mat) // int ** matrix, const int height, const int width)
 {
-  int ** a = mat->m;
   int height = mat->rows;
   int width = mat->cols;
   int x=0;
@@ -172,7 +340,7 @@ int AvgElement(Matrix * mat) // int ** matrix, const int height, const int width
   for (i=0; i<height; i++)
     for (j=0; j<width; j++)
     {
-      int *mm = a[i];
+      int *mm = MATRIX_ROW(mat, i);
       y=mm[j];
       x=x+y;
       ele++;
@@ -184,22 +352,19 @@ int AvgElement(Matrix * mat) // int ** matrix, const int height, const int width
   return x / ele;
 }
 
-int SumMatrix(Matrix * mat) {
-   int ** a = mat->m;
+long long SumMatrix(Matrix * mat) {
+   if (MATRIX_IS_SPARSE(mat))
+      return sparse_sum(mat);
+   if (mat->elem != ELEM_I32)
+      return elem_sum(mat);
    int height = mat->rows;
    int width = mat->cols;
-   int i =0;
-   int j =0;
-   int y =0;
-   int total = 0;
-   for (i = 0; i < height; i++)
+   // Densely packed rows can be summed as one long row
+   if (mat->stride == width)
    {
-      for (j = 0; j < width; j++)
-      {
-	  int *mm = a[i];
-	  y=mm[j];
-	  total = total+y;
-      }
+      width = height * width;
+      height = 1;
    }
-   return total;
+   sum_kernel_t kernel = select_sum_kernel(height, width);
+   return kernel(mat->data, mat->stride, height, width);
 }
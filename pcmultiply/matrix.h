@@ -9,21 +9,56 @@
 #define ROW 5
 #define COL 5
 
+// Cache line size; matrix headers and element storage are aligned to it
+#define MATRIX_ALIGN 64
+
+// A matrix is a single allocation: this header padded to MATRIX_ALIGN,
+// followed by rows * stride elements in row-major order.
+// stride - elements from the start of one row to the start of the next
+// elem   - element type (ELEM_* in elem.h); data points at elements of that
+//          type, so only ELEM_I32 matrices may be read through it as ints
+// nnz    - MATRIX_DENSE, or the stored elements of a CSR matrix, whose data
+//          holds values, row offsets and column indices instead (sparse.h)
+// pool   - owning matrix pool, NULL if the matrix came straight from malloc
+// next   - free list link while the matrix sits in a pool
+// stamp  - when the producer finished generating it (ns), for latency reports
+// sum    - sum of the elements, computed while generating; consumers count
+//          it instead of rescanning (valid for matrices a producer made)
 typedef struct matrix {
   int rows;
   int cols;
-  int ** m;
+  int stride;
+  int elem;
+  int nnz;
+  int * data;
+  struct matrix_pool * pool;
+  struct matrix * next;
+  unsigned long long stamp;
+  long long sum;
 } Matrix;
 
+// nnz of a dense matrix
+#define MATRIX_DENSE -1
+#define MATRIX_IS_SPARSE(mat) ((mat)->nnz != MATRIX_DENSE)
+
+// Pointer to the first element of row i (dense matrices only)
+#define MATRIX_ROW(mat, i) ((mat)->data + (size_t) (i) * (mat)->stride)
+
 //extern int theseed;
 
 // MATRIX ROUTINES
+Matrix * NewMatrix(int r, int c);
+Matrix * NewMatrixElem(int r, int c, int elem);
 Matrix * AllocMatrix(int r, int c);
+Matrix * AllocMatrixElem(int r, int c, int elem);
+Matrix * NewSparseMatrix(int r, int c, int nnz);
 void FreeMatrix(Matrix * mat);
 void GenMatrix(Matrix * mat);
 Matrix * GenMatrixRandom();
 int AvgElement(Matrix * mat);
-int SumMatrix(Matrix * mat);
+long long SumMatrix(Matrix * mat);
 Matrix * MatrixMultiply(Matrix * m1, Matrix * m2);
 void DisplayMatrix(Matrix * mat, FILE *stream);
+size_t FormatMatrixSize(Matrix * mat);
+size_t FormatMatrix(Matrix * mat, char * buf);
 Matrix * GenMatrixBySize(int row, int col);
@@ -0,0 +1,531 @@
+/*
+ *  microbench module
+ *  Times the matrix routines one at a time over a grid of sizes
+ *
+ *    microbench [options]
+ *    microbench --compare OLD NEW
+ *
+ *  Each routine (AllocMatrix, FreeMatrix, GenMatrix, SumMatrix,
+ *  MatrixMultiply, DisplayMatrix) is run on N x N matrices for every N
+ *  given.  A warmup pass sizes the trials so each lasts at least
+ *  --min-time; the median of --trials trials is reported as ns per call,
+ *  plus GFLOP/s (multiply) or GB/s of matrix elements (the others), and
+ *  time stamp counter cycles per element of an N x N matrix.
+ *
+ *  Allocations, frees and products are timed in batches, so the matrices
+ *  a batch needs are set up (or released) outside the timed region: the
+ *  alloc figure excludes the free and the other way round.
+ *
+ *  --compare reads two result files written with --format=json and
+ *  prints the change in ns per call of every routine and size in both.
+ *  It exits with status 1 if any of them got slower by more than
+ *  --threshold percent, so allocator and kernel changes can be judged
+ *  on the numbers.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "matrix.h"
+#include "elem.h"
+#include "kernels.h"
+#include "blockmult.h"
+#include "strassen.h"
+#include "rng.h"
+#include "hist.h"
+#include "pcmatrix.h"
+
+#define MAX_SIZES 32
+#define MAX_TRIALS 100
+#define MAX_RESULTS 256
+
+// Matrices per timed batch, fewer for large sizes (BATCH_BYTES at most)
+#define MAX_BATCH 64
+#define BATCH_BYTES (16 << 20)
+
+// ROUTINES UNDER TEST
+
+#define OP_ALLOC 0
+#define OP_FREE 1
+#define OP_GEN 2
+#define OP_SUM 3
+#define OP_MULT 4
+#define OP_DISPLAY 5
+#define OP_COUNT 6
+
+static const char * op_names[OP_COUNT] = { "alloc", "free", "gen", "sum", "mult", "display" };
+
+// One routine at one size
+typedef struct __result_t {
+  char op[16];
+  int n;
+  long iters;          // calls per trial
+  int trials;
+  double ns_per_op;    // median over the trials
+  double ns_min;
+  double gflops;       // multiply only
+  double gbps;         // the other routines
+  double cycles_per_elem;
+} result_t;
+
+static FILE * devnull;
+
+static uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int batch_for(int n)
+{
+  size_t bytes = (size_t) elem_sizes[ELEM_TYPE] * n * n + MATRIX_ALIGN;
+  size_t batch = BATCH_BYTES / bytes;
+  if (batch < 1)
+    batch = 1;
+  return (batch > MAX_BATCH) ? MAX_BATCH : (int) batch;
+}
+
+// Run op iters times on n x n matrices; returns the ns spent in the timed
+// calls and adds their cycles to *cyc
+static uint64_t run_op(int op, int n, long iters, uint64_t *cyc)
+{
+  Matrix * batch[MAX_BATCH];
+  int bn = batch_for(n);
+  uint64_t ns = 0, c = 0;
+  Matrix * a = AllocMatrixElem(n, n, ELEM_TYPE);
+  Matrix * b = AllocMatrixElem(n, n, ELEM_TYPE);
+  GenMatrix(a);
+  GenMatrix(b);
+
+  for (long done = 0; done < iters; )
+  {
+    int k = (iters - done < bn) ? (int) (iters - done) : bn;
+    uint64_t t0 = 0, c0 = 0;
+    switch (op)
+    {
+      case OP_ALLOC:
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          batch[i] = AllocMatrixElem(n, n, ELEM_TYPE);
+        c += cycles() - c0; ns += now_ns() - t0;
+        for (int i = 0; i < k; i++)
+          FreeMatrix(batch[i]);
+        break;
+      case OP_FREE:
+        for (int i = 0; i < k; i++)
+          batch[i] = AllocMatrixElem(n, n, ELEM_TYPE);
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          FreeMatrix(batch[i]);
+        c += cycles() - c0; ns += now_ns() - t0;
+        break;
+      case OP_GEN:
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          GenMatrix(a);
+        c += cycles() - c0; ns += now_ns() - t0;
+        break;
+      case OP_SUM:
+      {
+        volatile long long sink = 0;
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          sink += SumMatrix(a);
+        c += cycles() - c0; ns += now_ns() - t0;
+        (void) sink;
+        break;
+      }
+      case OP_MULT:
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          batch[i] = MatrixMultiply(a, b);
+        c += cycles() - c0; ns += now_ns() - t0;
+        for (int i = 0; i < k; i++)
+          if (batch[i] != NULL)
+            FreeMatrix(batch[i]);
+        break;
+      case OP_DISPLAY:
+        t0 = now_ns(); c0 = cycles();
+        for (int i = 0; i < k; i++)
+          DisplayMatrix(a, devnull);
+        fflush(devnull);
+        c += cycles() - c0; ns += now_ns() - t0;
+        break;
+    }
+    done += k;
+  }
+
+  FreeMatrix(a);
+  FreeMatrix(b);
+  *cyc += c;
+  return ns;
+}
+
+static int cmp_double(const void * a, const void * b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double median(double * v, int n)
+{
+  qsort(v, n, sizeof(double), cmp_double);
+  return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+// Warm up, size the trials to min_ns each and time them
+static void bench(int op, int n, int trials, uint64_t min_ns, result_t * r)
+{
+  uint64_t cyc = 0;
+  long iters = 1;
+  // warmup doubles the calls until one round takes min_ns / 4, which also
+  // fills the caches, the pools and the multiply helper threads
+  for (;;)
+  {
+    uint64_t ns = run_op(op, n, iters, &cyc);
+    if (ns >= min_ns / 4 || iters >= (1L << 40))
+    {
+      double per = (double) ns / iters;
+      iters = (per > 0) ? (long) (min_ns / per) + 1 : iters;
+      break;
+    }
+    iters *= 2;
+  }
+
+  double per_op[MAX_TRIALS];
+  double cyc_total = 0;
+  for (int t = 0; t < trials; t++)
+  {
+    uint64_t c = 0;
+    per_op[t] = (double) run_op(op, n, iters, &c) / iters;
+    cyc_total += (double) c / iters;
+  }
+
+  snprintf(r->op, sizeof(r->op), "%s", op_names[op]);
+  r->n = n;
+  r->iters = iters;
+  r->trials = trials;
+  r->ns_min = per_op[0];
+  for (int t = 1; t < trials; t++)
+    if (per_op[t] < r->ns_min)
+      r->ns_min = per_op[t];
+  r->ns_per_op = median(per_op, trials);
+  double elems = (double) n * n;
+  double bytes = elems * elem_sizes[ELEM_TYPE];
+  r->gflops = (op == OP_MULT) ? 2.0 * elems * n / r->ns_per_op : 0.0;
+  r->gbps = (op == OP_MULT) ? 0.0 : bytes / r->ns_per_op;
+  r->cycles_per_elem = cyc_total / trials / elems;
+}
+
+static void print_result(FILE * out, int csv, result_t * r)
+{
+  if (csv)
+    fprintf(out, "%s,%s,%d,%ld,%d,%.2f,%.2f,%.4f,%.4f,%.3f\n",
+            r->op, elem_names[ELEM_TYPE], r->n, r->iters, r->trials, r->ns_per_op, r->ns_min,
+            r->gflops, r->gbps, r->cycles_per_elem);
+  else
+    fprintf(out, "{\"op\":\"%s\",\"elem\":\"%s\",\"n\":%d,\"iters\":%ld,\"trials\":%d,"
+                 "\"ns_per_op\":%.2f,\"ns_min\":%.2f,\"gflops\":%.4f,\"gbps\":%.4f,"
+                 "\"cycles_per_elem\":%.3f}\n",
+            r->op, elem_names[ELEM_TYPE], r->n, r->iters, r->trials, r->ns_per_op, r->ns_min,
+            r->gflops, r->gbps, r->cycles_per_elem);
+  fflush(out);
+}
+
+// COMPARE MODE
+
+// Value of "key":number in a one-line JSON object
+static double json_number(const char * json, const char * key)
+{
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char * p = strstr(json, pattern);
+  return (p == NULL) ? 0.0 : strtod(p + strlen(pattern), NULL);
+}
+
+// Value of "key":"string" in a one-line JSON object, into buf
+static void json_string(const char * json, const char * key, char * buf, size_t size)
+{
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+  const char * p = strstr(json, pattern);
+  buf[0] = '\0';
+  if (p == NULL)
+    return;
+  p += strlen(pattern);
+  size_t len = strcspn(p, "\"");
+  if (len >= size)
+    len = size - 1;
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+}
+
+// Read a --format=json result file; returns the number of results or -1
+static int load_results(const char * path, result_t * rs, int max)
+{
+  FILE * f = fopen(path, "r");
+  if (f == NULL)
+  {
+    perror(path);
+    return -1;
+  }
+  char line[1024];
+  int n = 0;
+  while (n < max && fgets(line, sizeof(line), f) != NULL)
+  {
+    result_t * r = &rs[n];
+    json_string(line, "op", r->op, sizeof(r->op));
+    if (r->op[0] == '\0')
+      continue;
+    r->n = (int) json_number(line, "n");
+    r->ns_per_op = json_number(line, "ns_per_op");
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+static int compare(const char * old_path, const char * new_path, double threshold)
+{
+  static result_t old[MAX_RESULTS], cur[MAX_RESULTS];
+  int nold = load_results(old_path, old, MAX_RESULTS);
+  int ncur = load_results(new_path, cur, MAX_RESULTS);
+  if (nold < 0 || ncur < 0)
+    return 2;
+
+  int worse = 0, better = 0;
+  printf("%-8s %6s %14s %14s %9s\n", "op", "n", "old ns/op", "new ns/op", "change");
+  for (int i = 0; i < ncur; i++)
+    for (int j = 0; j < nold; j++)
+    {
+      if (strcmp(cur[i].op, old[j].op) != 0 || cur[i].n != old[j].n || old[j].ns_per_op <= 0)
+        continue;
+      double pct = 100.0 * (cur[i].ns_per_op - old[j].ns_per_op) / old[j].ns_per_op;
+      const char * mark = "";
+      if (pct > threshold)
+      {
+        mark = "  slower";
+        worse++;
+      }
+      else if (pct < -threshold)
+      {
+        mark = "  faster";
+        better++;
+      }
+      printf("%-8s %6d %14.2f %14.2f %+8.1f%%%s\n",
+             cur[i].op, cur[i].n, old[j].ns_per_op, cur[i].ns_per_op, pct, mark);
+      break;
+    }
+  printf("%d slower, %d faster by more than %.1f%%\n", worse, better, threshold);
+  return worse ? 1 : 0;
+}
+
+// Parse a comma separated list of sizes
+static int parse_sizes(char * s, int * v, int * n)
+{
+  *n = 0;
+  for (char * tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ","))
+  {
+    if (*n == MAX_SIZES || atoi(tok) < 1)
+      return -1;
+    v[(*n)++] = atoi(tok);
+  }
+  return (*n > 0) ? 0 : -1;
+}
+
+// Parse a comma separated list of routine names into a mask
+static int parse_ops(char * s, int * mask)
+{
+  *mask = 0;
+  for (char * tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ","))
+  {
+    int found = 0;
+    for (int i = 0; i < OP_COUNT; i++)
+      if (strcmp(tok, op_names[i]) == 0)
+      {
+        *mask |= 1 << i;
+        found = 1;
+      }
+    if (!found)
+      return -1;
+  }
+  return (*mask != 0) ? 0 : -1;
+}
+
+static void usage(char * prog)
+{
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "       %s [--threshold=PCT] --compare OLD NEW\n"
+    "  --ops=LIST          routines: alloc,free,gen,sum,mult,display (default all)\n"
+    "  --sizes=LIST        matrix orders N (default 1,2,3,4,8,16,32,64,128,256,512,1024)\n"
+    "  --trials=N          timed trials per routine and size (default 5)\n"
+    "  --min-time=MS       length of one trial (default 50)\n"
+    "  --pool              allocate through the matrix pool\n"
+    "  --elem=TYPE         element type as for pcMatrix (default i32)\n"
+    "  --kernel=ISA        auto|scalar|sse2|avx2 (default auto)\n"
+    "  --mult-threads=N    threads per large multiply (default: online CPUs)\n"
+    "  --format=json|csv   output format (default json, one object per line)\n"
+    "  --out=FILE          write results to FILE (default stdout)\n"
+    "  --compare OLD NEW   compare two json result files\n"
+    "  --threshold=PCT     change that counts as slower or faster (default 5)\n"
+    "LIST is comma separated, e.g. --sizes=1,4,256\n", prog, prog);
+}
+
+int main(int argc, char * argv[])
+{
+  static const char * kernel_names[] = { "auto", "scalar", "sse2", "avx2" };
+  int sizes[MAX_SIZES] = { 1, 2, 3, 4, 8, 16, 32, 64, 128, 256, 512, 1024 };
+  int nsizes = 12;
+  int ops = (1 << OP_COUNT) - 1;
+  int trials = 5;
+  int min_ms = 50;
+  int csv = 0;
+  int comparing = 0;
+  double threshold = 5.0;
+  FILE * out = stdout;
+
+  PARALLEL_THRESHOLD = DEFAULT_PARALLEL_THRESHOLD;
+  STRASSEN_THRESHOLD = DEFAULT_STRASSEN_THRESHOLD;
+  STRASSEN_CROSSOVER = DEFAULT_STRASSEN_CROSSOVER;
+  KERNEL_ISA = KERNEL_AUTO;
+
+  static struct option longopts[] = {
+    {"ops",       required_argument, NULL, 'o'},
+    {"sizes",     required_argument, NULL, 'n'},
+    {"trials",    required_argument, NULL, 't'},
+    {"min-time",  required_argument, NULL, 'm'},
+    {"pool",      no_argument,       NULL, 'p'},
+    {"elem",      required_argument, NULL, 'E'},
+    {"kernel",    required_argument, NULL, 'k'},
+    {"mult-threads", required_argument, NULL, 'M'},
+    {"format",    required_argument, NULL, 'f'},
+    {"out",       required_argument, NULL, 'O'},
+    {"compare",   no_argument,       NULL, 'c'},
+    {"threshold", required_argument, NULL, 'T'},
+    {"help",      no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  int longindex = 0;
+  while ((opt = getopt_long(argc, argv, "h", longopts, &longindex)) != -1)
+  {
+    int bad = 0;
+    switch (opt)
+    {
+      case 'o': bad = parse_ops(optarg, &ops); break;
+      case 'n': bad = parse_sizes(optarg, sizes, &nsizes); break;
+      case 't':
+        trials = atoi(optarg);
+        bad = (trials < 1 || trials > MAX_TRIALS);
+        break;
+      case 'm':
+        min_ms = atoi(optarg);
+        bad = (min_ms < 1);
+        break;
+      case 'p': MATRIX_POOL = 1; break;
+      case 'E':
+        ELEM_TYPE = elem_lookup(optarg);
+        bad = (ELEM_TYPE < 0);
+        break;
+      case 'k':
+        KERNEL_ISA = -1;
+        for (int i = 0; i < (int) (sizeof(kernel_names) / sizeof(kernel_names[0])); i++)
+          if (strcmp(optarg, kernel_names[i]) == 0)
+            KERNEL_ISA = i;
+        bad = (KERNEL_ISA < 0);
+        break;
+      case 'M':
+        MULT_THREADS = atoi(optarg);
+        bad = (MULT_THREADS < 1);
+        break;
+      case 'f':
+        csv = (strcmp(optarg, "csv") == 0);
+        bad = !csv && strcmp(optarg, "json") != 0;
+        break;
+      case 'O':
+        out = fopen(optarg, "w");
+        if (out == NULL)
+        {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'c': comparing = 1; break;
+      case 'T':
+        threshold = atof(optarg);
+        bad = (threshold < 0);
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+    if (bad)
+    {
+      fprintf(stderr, "microbench: bad value for --%s\n", longopts[longindex].name);
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (comparing)
+  {
+    if (argc - optind != 2)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+    return compare(argv[optind], argv[optind + 1], threshold);
+  }
+
+  if (kernels_init(KERNEL_ISA) != 0)
+  {
+    fprintf(stderr, "This CPU does not support the %s kernels\n", kernel_names[KERNEL_ISA]);
+    return 1;
+  }
+  if (MULT_THREADS <= 0)
+    MULT_THREADS = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  devnull = fopen("/dev/null", "w");
+  if (devnull == NULL)
+  {
+    perror("/dev/null");
+    return 1;
+  }
+  rng_master_seed(1);
+  rng_thread_seed(0);
+
+  if (csv)
+    fprintf(out, "op,elem,n,iters,trials,ns_per_op,ns_min,gflops,gbps,cycles_per_elem\n");
+  for (int op = 0; op < OP_COUNT; op++)
+  {
+    if (!(ops & (1 << op)))
+      continue;
+    for (int i = 0; i < nsizes; i++)
+    {
+      result_t r;
+      bench(op, sizes[i], trials, (uint64_t) min_ms * 1000000ULL, &r);
+      print_result(out, csv, &r);
+    }
+  }
+
+  blocked_shutdown();
+  fclose(devnull);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ *  Binary matrix stream routines
+ *
+ *  A view is a Matrix header of its own whose data points into the
+ *  mapping.  Its pool is NULL, so FreeMatrix() frees only the header and
+ *  the elements stay in the file.  The mapping must outlive every view.
+ *
+ *  Every record is checked against the file size when the stream is
+ *  opened, so mstream_view() can trust what it reads.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "elem.h"
+#include "sparse.h"
+#include "mstream.h"
+
+// A record at off must lie wholly inside the file
+static int record_ok(mstream_t *s, uint64_t off)
+{
+  if (off % MSTREAM_ALIGN != 0 || off > s->size || s->size - off < sizeof(mstream_record_t))
+    return 0;
+  const mstream_record_t *r = (const mstream_record_t *) (s->base + off);
+  if (r->rows < 0 || r->cols < 0 || r->rows > (1 << 20) || r->cols > (1 << 20))
+    return 0;
+  return MSTREAM_RECORD_SIZE(r->rows, r->cols) <= s->size - off;
+}
+
+// Report record i as bad and unmap the stream; returns -1
+static int corrupt_record(mstream_t *s, const char *path, uint64_t i)
+{
+  fprintf(stderr, "%s: record %llu is truncated or corrupt\n", path, (unsigned long long) i);
+  mstream_close(s);
+  return -1;
+}
+
+// Map path and locate its records; prints the reason and returns -1 on failure
+int mstream_open(mstream_t *s, const char *path)
+{
+  memset(s, 0, sizeof(*s));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror(path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(mstream_header_t))
+  {
+    fprintf(stderr, "%s: not a matrix stream\n", path);
+    close(fd);
+    return -1;
+  }
+  s->size = (size_t) st.st_size;
+  void *p = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+  {
+    perror(path);
+    return -1;
+  }
+  s->base = (const char *) p;
+
+  const mstream_header_t *h = (const mstream_header_t *) s->base;
+  if (memcmp(h->magic, MSTREAM_MAGIC, 8) != 0 || h->version != MSTREAM_VERSION ||
+      h->elem_size != sizeof(int32_t) || h->data_offset < sizeof(mstream_header_t))
+  {
+    fprintf(stderr, "%s: not a version %d matrix stream\n", path, MSTREAM_VERSION);
+    mstream_close(s);
+    return -1;
+  }
+  s->count = h->count;
+  // every record takes at least a record header
+  if (h->data_offset > s->size ||
+      (s->size - h->data_offset) / sizeof(mstream_record_t) < s->count)
+  {
+    fprintf(stderr, "%s: %llu records do not fit in the file\n", path, (unsigned long long) s->count);
+    mstream_close(s);
+    return -1;
+  }
+
+  if (h->index_offset != 0)
+  {
+    // Use the index in place
+    if (h->index_offset % MSTREAM_ALIGN != 0 || h->index_offset > s->size ||
+        (s->size - h->index_offset) / sizeof(uint64_t) < s->count)
+    {
+      fprintf(stderr, "%s: bad record index\n", path);
+      mstream_close(s);
+      return -1;
+    }
+    s->offsets = (const uint64_t *) (s->base + h->index_offset);
+    for (uint64_t i = 0; i < s->count; i++)
+    {
+      if (!record_ok(s, s->offsets[i]))
+        return corrupt_record(s, path, i);
+    }
+  }
+  else
+  {
+    // No index: walk the record headers to build one
+    s->scanned = (uint64_t *) malloc(sizeof(uint64_t) * (s->count ? s->count : 1));
+    if (s->scanned == NULL)
+    {
+      mstream_close(s);
+      return -1;
+    }
+    uint64_t off = h->data_offset;
+    for (uint64_t i = 0; i < s->count; i++)
+    {
+      if (!record_ok(s, off))
+        return corrupt_record(s, path, i);
+      s->scanned[i] = off;
+      const mstream_record_t *r = (const mstream_record_t *) (s->base + off);
+      off += MSTREAM_RECORD_SIZE(r->rows, r->cols);
+    }
+    s->offsets = s->scanned;
+  }
+
+  madvise((void *) s->base, s->size, MADV_WILLNEED);
+  return 0;
+}
+
+// Zero-copy Matrix for record i, or NULL if its header cannot be allocated
+Matrix * mstream_view(mstream_t *s, uint64_t i)
+{
+  const mstream_record_t *r = (const mstream_record_t *) (s->base + s->offsets[i]);
+  Matrix *mat = (Matrix *) malloc(sizeof(Matrix));
+  if (mat == NULL)
+    return NULL;
+  mat->rows = r->rows;
+  mat->cols = r->cols;
+  mat->stride = r->cols;
+  mat->elem = ELEM_I32;
+  mat->nnz = MATRIX_DENSE;
+  mat->data = (int *) (r + 1);
+  mat->pool = NULL;
+  mat->next = NULL;
+  mat->stamp = 0;
+  mat->sum = 0;
+  return mat;
+}
+
+void mstream_close(mstream_t *s)
+{
+  if (s->base != NULL)
+    munmap((void *) s->base, s->size);
+  free(s->scanned);
+  memset(s, 0, sizeof(*s));
+}
+
+void mstream_init_header(mstream_header_t *h)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, MSTREAM_MAGIC, 8);
+  h->version = MSTREAM_VERSION;
+  h->elem_size = sizeof(int32_t);
+  h->data_offset = sizeof(mstream_header_t);
+}
+
+// Write mat as a record at dst, which has MSTREAM_RECORD_SIZE bytes of
+// room; returns the bytes written.  i8 and i16 elements are widened to
+// int32, other non-int types must not get here.  CSR matrices are
+// written out dense.
+size_t mstream_encode(void *dst, Matrix *mat, uint32_t tag)
+{
+  if (MATRIX_IS_SPARSE(mat))
+  {
+    Matrix *dense = sparse_to_dense(mat);
+    size_t size = mstream_encode(dst, dense, tag);
+    FreeMatrix(dense);
+    return size;
+  }
+  mstream_record_t *r = (mstream_record_t *) dst;
+  r->rows = mat->rows;
+  r->cols = mat->cols;
+  r->tag = tag;
+  r->reserved = 0;
+  char *p = (char *) (r + 1);
+  size_t row_bytes = sizeof(int32_t) * (size_t) mat->cols;
+  if (mat->elem == ELEM_I32)
+    for (int i = 0; i < mat->rows; i++)
+      memcpy(p + i * row_bytes, MATRIX_ROW(mat, i), row_bytes);
+  else
+  {
+    int32_t *out = (int32_t *) p;
+    for (int i = 0; i < mat->rows; i++)
+      for (int j = 0; j < mat->cols; j++)
+        *out++ = (mat->elem == ELEM_I8) ? MATRIX_AT(mat, int8_t, i, j) : MATRIX_AT(mat, int16_t, i, j);
+  }
+  size_t size = MSTREAM_RECORD_SIZE(mat->rows, mat->cols);
+  size_t used = sizeof(mstream_record_t) + row_bytes * mat->rows;
+  memset((char *) dst + used, 0, size - used);
+  return size;
+}
+
+int mstream_create(mstream_writer_t *w, const char *path)
+{
+  memset(w, 0, sizeof(*w));
+  w->f = fopen(path, "wb");
+  if (w->f == NULL)
+  {
+    perror(path);
+    return -1;
+  }
+  // Placeholder header, rewritten by mstream_finish()
+  mstream_header_t h;
+  mstream_init_header(&h);
+  if (fwrite(&h, sizeof(h), 1, w->f) != 1)
+  {
+    perror(path);
+    fclose(w->f);
+    return -1;
+  }
+  w->offset = sizeof(h);
+  return 0;
+}
+
+int mstream_write(mstream_writer_t *w, Matrix *mat, uint32_t tag)
+{
+  if (w->count == w->index_cap)
+  {
+    size_t cap = w->index_cap ? 2 * w->index_cap : 1024;
+    uint64_t *index = (uint64_t *) realloc(w->index, sizeof(uint64_t) * cap);
+    if (index == NULL)
+      return -1;
+    w->index = index;
+    w->index_cap = cap;
+  }
+  size_t size = MSTREAM_RECORD_SIZE(mat->rows, mat->cols);
+  char stackbuf[256];
+  char *buf = (size <= sizeof(stackbuf)) ? stackbuf : (char *) malloc(size);
+  if (buf == NULL)
+    return -1;
+  mstream_encode(buf, mat, tag);
+  size_t n = fwrite(buf, 1, size, w->f);
+  if (buf != stackbuf)
+    free(buf);
+  if (n != size)
+    return -1;
+  w->index[w->count++] = w->offset;
+  w->offset += size;
+  return 0;
+}
+
+// Append the index, fill in the header and close the file
+int mstream_finish(mstream_writer_t *w)
+{
+  int rc = 0;
+  mstream_header_t h;
+  mstream_init_header(&h);
+  h.count = w->count;
+  h.index_offset = w->offset;
+  if (w->count > 0 && fwrite(w->index, sizeof(uint64_t), w->count, w->f) != w->count)
+    rc = -1;
+  if (rc == 0 && (fseek(w->f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, w->f) != 1))
+    rc = -1;
+  if (fclose(w->f) != 0)
+    rc = -1;
+  free(w->index);
+  w->index = NULL;
+  return rc;
+}
@@ -0,0 +1,84 @@
+/*
+ *  mstream header
+ *  Function prototypes, data, and constants for the binary matrix stream module
+ *
+ *  File layout (host byte order, every part starts on an MSTREAM_ALIGN
+ *  boundary):
+ *
+ *    mstream_header_t                       64 bytes
+ *    record 0 .. count-1                    mstream_record_t + payload
+ *    index (optional)                       uint64_t offset of each record
+ *
+ *  A record's payload is rows * cols 32-bit elements in row-major order,
+ *  zero padded to MSTREAM_ALIGN.  Without an index a reader finds the
+ *  records by walking their headers from data_offset.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdint.h>
+
+#define MSTREAM_MAGIC "PCMATRX1"
+#define MSTREAM_VERSION 1
+#define MSTREAM_ALIGN 16
+
+// Bytes taken by a record of the given shape, header and padding included
+#define MSTREAM_RECORD_SIZE(rows, cols) \
+  (sizeof(mstream_record_t) + \
+   (((size_t) (rows) * (cols) * sizeof(int32_t) + MSTREAM_ALIGN - 1) / MSTREAM_ALIGN) * MSTREAM_ALIGN)
+
+// MATRIX STREAM
+
+typedef struct __mstream_header_t {
+  char magic[8];            // MSTREAM_MAGIC, not NUL terminated
+  uint32_t version;         // MSTREAM_VERSION
+  uint32_t elem_size;       // bytes per element, 4
+  uint64_t count;           // number of records
+  uint64_t data_offset;     // first record
+  uint64_t index_offset;    // count record offsets, 0 if there is no index
+  uint8_t reserved[24];
+} mstream_header_t;
+
+// record tags, for streams that mix operands and products
+#define MSTREAM_TAG_MATRIX 0
+#define MSTREAM_TAG_LEFT 1
+#define MSTREAM_TAG_RIGHT 2
+#define MSTREAM_TAG_PRODUCT 3
+
+typedef struct __mstream_record_t {
+  int32_t rows;
+  int32_t cols;
+  uint32_t tag;             // MSTREAM_TAG_*
+  uint32_t reserved;
+} mstream_record_t;
+
+// a mapped stream, open for reading
+typedef struct __mstream_t {
+  const char * base;        // the whole file, mapped read-only
+  size_t size;
+  uint64_t count;
+  const uint64_t * offsets; // from the file's index, or built by scanning
+  uint64_t * scanned;       // offsets we built and must free
+} mstream_t;
+
+// a stream being written sequentially
+typedef struct __mstream_writer_t {
+  FILE * f;
+  uint64_t count;
+  uint64_t offset;          // where the next record goes
+  uint64_t * index;
+  size_t index_cap;
+} mstream_writer_t;
+
+// reading
+int mstream_open(mstream_t *s, const char *path);
+Matrix * mstream_view(mstream_t *s, uint64_t i);
+void mstream_close(mstream_t *s);
+
+// writing
+void mstream_init_header(mstream_header_t *h);
+size_t mstream_encode(void *dst, Matrix *mat, uint32_t tag);
+int mstream_create(mstream_writer_t *w, const char *path);
+int mstream_write(mstream_writer_t *w, Matrix *mat, uint32_t tag);
+int mstream_finish(mstream_writer_t *w);
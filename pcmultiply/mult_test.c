@@ -0,0 +1,312 @@
+/*
+ *  mult_test
+ *  Differential test of the large-product multiply paths
+ *
+ *    mult_test [threads]
+ *
+ *  With MULT_THREADS set to threads (default 1), products from
+ *  blocked_multiply(), and from MatrixMultiply() on either side of
+ *  PARALLEL_THRESHOLD, are compared element for element with
+ *  mult_scalar() on full-range random ints.  Shapes straddle BLOCK_MC,
+ *  BLOCK_NC and BLOCK_KC, so partial tiles and partial panels are
+ *  covered, and operands and results have padded row strides.
+ *
+ *  strassen_multiply() is checked the same way on odd and even orders,
+ *  which need padding or not, with every crossover from 1 to 64; order
+ *  1000 only with a few, to keep the run short.  With threads > 1 its
+ *  top level runs on the thread pool.
+ *
+ *  Sparse products are checked on every dense / CSR operand combination,
+ *  at several densities, against mult_scalar() on the dense forms.  CSR
+ *  operands and products must have ascending column indices, and
+ *  sparse_sum() must equal SumMatrix() of the dense form.
+ *
+ *  Prints one line per path; exits with status 1 at the first mismatch.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "matrix.h"
+#include "kernels.h"
+#include "blockmult.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "rng.h"
+#include "pcmatrix.h"
+
+// Shapes around the tile sizes and the parallel threshold
+static const int block_m[] = { 1, 63, 64, 65, 129 };
+static const int block_k[] = { 1, 255, 256, 257, 513 };
+static const int block_n[] = { 1, 127, 128, 129, 257 };
+#define BLOCK_SHAPES ((int) (sizeof(block_m) / sizeof(block_m[0])))
+
+// Strassen orders tried with every crossover 1..STRASSEN_MAX_CROSSOVER,
+// and the large order tried with a few
+static const int strassen_orders[] = { 1, 2, 3, 63, 64, 65, 150 };
+#define STRASSEN_ORDERS ((int) (sizeof(strassen_orders) / sizeof(strassen_orders[0])))
+#define STRASSEN_MAX_CROSSOVER 64
+#define STRASSEN_LARGE 1000
+static const int large_crossovers[] = { 7, 32, 64 };
+#define LARGE_CROSSOVERS ((int) (sizeof(large_crossovers) / sizeof(large_crossovers[0])))
+
+// Sparse shapes (every m x k times k x n) and densities
+static const int sparse_dims[] = { 1, 7, 33, 100 };
+#define SPARSE_DIMS ((int) (sizeof(sparse_dims) / sizeof(sparse_dims[0])))
+static const double densities[] = { 0.0, 0.01, 0.05, 0.2, 0.6 };
+#define DENSITIES ((int) (sizeof(densities) / sizeof(densities[0])))
+
+static rng_t rng;
+
+// r x c int matrix of full-range random values whose rows are pad
+// elements longer than c
+static Matrix * random_matrix(int r, int c, int pad)
+{
+  Matrix * mat = NewMatrix(r, c + pad);
+  mat->cols = c;
+  for (int i = 0; i < r; i++)
+    for (int j = 0; j < c; j++)
+      MATRIX_ROW(mat, i)[j] = (int) rng_next(&rng);
+  return mat;
+}
+
+// Uninitialised r x c result with row stride c + pad
+static Matrix * result_matrix(int r, int c, int pad)
+{
+  Matrix * mat = NewMatrix(r, c + pad);
+  mat->cols = c;
+  return mat;
+}
+
+static Matrix * reference(Matrix * a, Matrix * b)
+{
+  Matrix * want = NewMatrix(a->rows, b->cols);
+  mult_scalar(a->data, a->stride, b->data, b->stride,
+              want->data, want->stride, a->rows, a->cols, b->cols);
+  return want;
+}
+
+// Nonzero, after saying where, if got and want differ
+static int differs(const char * what, Matrix * a, Matrix * got, Matrix * want)
+{
+  if (got == NULL || got->rows != want->rows || got->cols != want->cols)
+  {
+    fprintf(stderr, "mult_test: %s %dx%dx%d gave no product of the right shape\n",
+            what, a->rows, a->cols, want->cols);
+    return 1;
+  }
+  for (int i = 0; i < want->rows; i++)
+    for (int j = 0; j < want->cols; j++)
+      if (MATRIX_ROW(got, i)[j] != MATRIX_ROW(want, i)[j])
+      {
+        fprintf(stderr, "mult_test: %s %dx%dx%d differs at row %d col %d: %d, expected %d\n",
+                what, a->rows, a->cols, want->cols, i, j,
+                MATRIX_ROW(got, i)[j], MATRIX_ROW(want, i)[j]);
+        return 1;
+      }
+  return 0;
+}
+
+// blocked_multiply() directly, and MatrixMultiply(), which takes the
+// blocked path only from PARALLEL_THRESHOLD up
+static int test_blocked()
+{
+  int products = 0;
+  for (int x = 0; x < BLOCK_SHAPES; x++)
+    for (int y = 0; y < BLOCK_SHAPES; y++)
+      for (int z = 0; z < BLOCK_SHAPES; z++)
+      {
+        int m = block_m[x], k = block_k[y], n = block_n[z];
+        Matrix * a = random_matrix(m, k, (m + k) % 3);
+        Matrix * b = random_matrix(k, n, 1 + (k + n) % 3);
+        Matrix * want = reference(a, b);
+        Matrix * got = result_matrix(m, n, 2);
+        blocked_multiply(a, b, got);
+        Matrix * dispatched = MatrixMultiply(a, b);
+        int bad = differs("blocked", a, got, want) || differs("MatrixMultiply", a, dispatched, want);
+        FreeMatrix(a);
+        FreeMatrix(b);
+        FreeMatrix(want);
+        FreeMatrix(got);
+        if (dispatched != NULL)
+          FreeMatrix(dispatched);
+        if (bad)
+          return 1;
+        products += 2;
+      }
+  printf("mult_test: %d threads, blocked ok, %d products match\n", MULT_THREADS, products);
+  return 0;
+}
+
+// strassen_multiply() of order n with each of the crossovers given
+static int strassen_order(int n, const int * crossovers, int count, int * products)
+{
+  Matrix * a = random_matrix(n, n, n % 2);
+  Matrix * b = random_matrix(n, n, 1 + n % 3);
+  Matrix * want = reference(a, b);
+  Matrix * got = result_matrix(n, n, 3);
+  int bad = 0;
+  for (int i = 0; i < count && !bad; i++)
+  {
+    char what[32];
+    snprintf(what, sizeof(what), "strassen crossover %d", crossovers[i]);
+    STRASSEN_CROSSOVER = crossovers[i];
+    if (strassen_multiply(a, b, got) != 0)
+    {
+      fprintf(stderr, "mult_test: %s order %d could not allocate\n", what, n);
+      bad = 1;
+    }
+    else
+      bad = differs(what, a, got, want);
+    (*products)++;
+  }
+  FreeMatrix(a);
+  FreeMatrix(b);
+  FreeMatrix(want);
+  FreeMatrix(got);
+  return bad;
+}
+
+static int test_strassen()
+{
+  int crossovers[STRASSEN_MAX_CROSSOVER];
+  for (int i = 0; i < STRASSEN_MAX_CROSSOVER; i++)
+    crossovers[i] = i + 1;
+  int products = 0;
+  for (int i = 0; i < STRASSEN_ORDERS; i++)
+    if (strassen_order(strassen_orders[i], crossovers, STRASSEN_MAX_CROSSOVER, &products))
+      return 1;
+  if (strassen_order(STRASSEN_LARGE, large_crossovers, LARGE_CROSSOVERS, &products))
+    return 1;
+  STRASSEN_CROSSOVER = DEFAULT_STRASSEN_CROSSOVER;
+  printf("mult_test: %d threads, strassen ok, %d products match\n", MULT_THREADS, products);
+  return 0;
+}
+
+// Nonzero, after saying why, if a CSR matrix is malformed or its column
+// indices are not ascending within each row
+static int bad_csr(const char * what, Matrix * mat)
+{
+  const int * rowptr = CSR_ROWPTR(mat);
+  const int * colidx = CSR_COLIDX(mat);
+  if (rowptr[0] != 0 || rowptr[mat->rows] != mat->nnz)
+  {
+    fprintf(stderr, "mult_test: %s %dx%d CSR row offsets do not span its %d elements\n",
+            what, mat->rows, mat->cols, mat->nnz);
+    return 1;
+  }
+  for (int i = 0; i < mat->rows; i++)
+    for (int p = rowptr[i]; p < rowptr[i + 1]; p++)
+      if (colidx[p] < 0 || colidx[p] >= mat->cols || (p > rowptr[i] && colidx[p] <= colidx[p - 1]))
+      {
+        fprintf(stderr, "mult_test: %s %dx%d CSR row %d column indices are not ascending\n",
+                what, mat->rows, mat->cols, i);
+        return 1;
+      }
+  return 0;
+}
+
+// CSR r x c matrix at the given density with full-range nonzero values;
+// *dense gets its dense form
+static Matrix * random_csr(int r, int c, double density, Matrix ** dense)
+{
+  DENSITY = density;
+  SPARSE_RATIO = 1.0;   // always CSR
+  Matrix * mat = sparse_gen(r, c);
+  for (int p = 0; p < mat->nnz; p++)
+    CSR_VALUES(mat)[p] = (int) (rng_next(&rng) | 1);
+  *dense = sparse_to_dense(mat);
+  return mat;
+}
+
+// Nonzero if the CSR matrix is malformed or its sum is not the dense sum
+static int check_csr(const char * what, Matrix * mat)
+{
+  if (bad_csr(what, mat))
+    return 1;
+  Matrix * dense = sparse_to_dense(mat);
+  long long want = SumMatrix(dense);
+  long long got = sparse_sum(mat);
+  FreeMatrix(dense);
+  if (got != want)
+  {
+    fprintf(stderr, "mult_test: %s %dx%d sparse_sum is %lld, expected %lld\n",
+            what, mat->rows, mat->cols, got, want);
+    return 1;
+  }
+  return 0;
+}
+
+// Every dense / CSR combination of a (m x k) and b (k x n) at one density,
+// with CSR products kept (ratio 1) or stored dense when not sparse enough
+static int sparse_shape(int m, int k, int n, double density, int * products)
+{
+  Matrix *ad, *bd;
+  Matrix * as = random_csr(m, k, density, &ad);
+  Matrix * bs = random_csr(k, n, density, &bd);
+  Matrix * want = reference(ad, bd);
+  Matrix * left[2] = { ad, as };
+  Matrix * right[2] = { bd, bs };
+  static const char * names[4] = { "dense x dense", "dense x csr", "csr x dense", "csr x csr" };
+  static const double ratios[2] = { 1.0, DEFAULT_SPARSE_RATIO };
+  int bad = check_csr("operand", as) || check_csr("operand", bs);
+
+  for (int r = 0; r < 2 && !bad; r++)
+    for (int combo = 0; combo < 4 && !bad; combo++)
+    {
+      SPARSE_RATIO = ratios[r];
+      Matrix * got = MatrixMultiply(left[combo >> 1], right[combo & 1]);
+      if (got != NULL && MATRIX_IS_SPARSE(got))
+      {
+        bad = check_csr(names[combo], got);
+        Matrix * dense = sparse_to_dense(got);
+        FreeMatrix(got);
+        got = dense;
+      }
+      bad = bad || differs(names[combo], ad, got, want);
+      if (got != NULL)
+        FreeMatrix(got);
+      (*products)++;
+    }
+  FreeMatrix(as);
+  FreeMatrix(bs);
+  FreeMatrix(ad);
+  FreeMatrix(bd);
+  FreeMatrix(want);
+  return bad;
+}
+
+static int test_sparse()
+{
+  int products = 0;
+  for (int d = 0; d < DENSITIES; d++)
+    for (int x = 0; x < SPARSE_DIMS; x++)
+      for (int y = 0; y < SPARSE_DIMS; y++)
+        for (int z = 0; z < SPARSE_DIMS; z++)
+          if (sparse_shape(sparse_dims[x], sparse_dims[y], sparse_dims[z], densities[d], &products))
+            return 1;
+  printf("mult_test: %d threads, sparse ok, %d products match\n", MULT_THREADS, products);
+  return 0;
+}
+
+int main(int argc, char * argv[])
+{
+  MULT_THREADS = (argc > 1) ? atoi(argv[1]) : 1;
+  if (MULT_THREADS < 1)
+  {
+    fprintf(stderr, "usage: %s [threads]\n", argv[0]);
+    return 2;
+  }
+  PARALLEL_THRESHOLD = DEFAULT_PARALLEL_THRESHOLD;
+  STRASSEN_THRESHOLD = 0;
+  kernels_init(KERNEL_AUTO);
+  rng_seed(&rng, 422, 0);
+  rng_master_seed(422);
+  rng_thread_seed(0);
+
+  int rc = test_blocked() || test_strassen() || test_sparse();
+  blocked_shutdown();
+  return rc;
+}
@@ -0,0 +1,313 @@
+/*
+ *  pcbench module
+ *  End-to-end throughput benchmark driver for pcMatrix
+ *
+ *  Sweeps worker threads, bounded buffer size, number of matrices and
+ *  matrix mode.  Every configuration is run several times as
+ *
+ *    pcMatrix [extra options] --quiet --report=FILE workers buffer matrices mode
+ *
+ *  and the per-run JSON report is combined with the CPU time and wall
+ *  time measured here.  Each configuration yields one result: the median
+ *  over its runs of matrices/sec, multiplications/sec, p50/p99 per-item
+ *  latency and CPU use.  Results are written as JSON lines or CSV.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define MAX_VALUES 32
+#define MAX_REPEAT 100
+#define MAX_EXTRA 32
+
+// One list of values to sweep, e.g. --workers=1,2,4
+typedef struct __sweep_t {
+  int n;
+  int v[MAX_VALUES];
+} sweep_t;
+
+// Measurements from one run
+typedef struct __run_t {
+  double matrices_per_s;
+  double mults_per_s;
+  double p50_ns;
+  double p99_ns;
+  double wall_s;
+  double cpu_s;
+  int balanced;
+} run_t;
+
+static char * pcmatrix = "./pcMatrix";
+static char * extra[MAX_EXTRA];
+static int nextra = 0;
+
+static int parse_list(char * s, sweep_t * sw)
+{
+  sw->n = 0;
+  for (char * tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ","))
+  {
+    if (sw->n == MAX_VALUES)
+      return -1;
+    sw->v[sw->n++] = atoi(tok);
+  }
+  return (sw->n > 0) ? 0 : -1;
+}
+
+// Value of "key":number in a one-line JSON object
+static double json_number(const char * json, const char * key)
+{
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char * p = strstr(json, pattern);
+  return (p == NULL) ? 0.0 : strtod(p + strlen(pattern), NULL);
+}
+
+static double timespec_s(struct timespec * t)
+{
+  return (double) t->tv_sec + (double) t->tv_nsec / 1e9;
+}
+
+// Run pcMatrix once; returns 0 and fills r on success
+static int run_once(int workers, int buffer, int matrices, int mode, run_t * r)
+{
+  char report[] = "/tmp/pcbench.XXXXXX";
+  int fd = mkstemp(report);
+  if (fd < 0)
+  {
+    perror("mkstemp");
+    return -1;
+  }
+  close(fd);
+
+  char a_workers[16], a_buffer[16], a_matrices[16], a_mode[16], a_report[64];
+  snprintf(a_workers, sizeof(a_workers), "%d", workers);
+  snprintf(a_buffer, sizeof(a_buffer), "%d", buffer);
+  snprintf(a_matrices, sizeof(a_matrices), "%d", matrices);
+  snprintf(a_mode, sizeof(a_mode), "%d", mode);
+  snprintf(a_report, sizeof(a_report), "--report=%s", report);
+
+  char * argv[MAX_EXTRA + 8];
+  int argc = 0;
+  argv[argc++] = pcmatrix;
+  for (int i = 0; i < nextra; i++)
+    argv[argc++] = extra[i];
+  argv[argc++] = "--quiet";
+  argv[argc++] = a_report;
+  argv[argc++] = a_workers;
+  argv[argc++] = a_buffer;
+  argv[argc++] = a_matrices;
+  argv[argc++] = a_mode;
+  argv[argc] = NULL;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0)
+      dup2(devnull, STDOUT_FILENO);
+    execv(pcmatrix, argv);
+    perror(pcmatrix);
+    _exit(127);
+  }
+  if (pid < 0)
+  {
+    perror("fork");
+    unlink(report);
+    return -1;
+  }
+
+  int status;
+  struct rusage ru;
+  if (wait4(pid, &status, 0, &ru) < 0)
+  {
+    perror("wait4");
+    unlink(report);
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  char line[1024] = "";
+  FILE * f = fopen(report, "r");
+  if (f != NULL)
+  {
+    if (fgets(line, sizeof(line), f) == NULL)
+      line[0] = '\0';
+    fclose(f);
+  }
+  unlink(report);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || line[0] == '\0')
+  {
+    fprintf(stderr, "pcbench: run failed: workers=%d buffer=%d matrices=%d mode=%d\n",
+            workers, buffer, matrices, mode);
+    return -1;
+  }
+
+  r->matrices_per_s = json_number(line, "matrices_per_s");
+  r->mults_per_s = json_number(line, "mults_per_s");
+  r->p50_ns = json_number(line, "latency_p50_ns");
+  r->p99_ns = json_number(line, "latency_p99_ns");
+  r->wall_s = timespec_s(&t1) - timespec_s(&t0);
+  r->cpu_s = (double) ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+             (double) ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+  r->balanced = json_number(line, "produced") == json_number(line, "consumed");
+  return 0;
+}
+
+static int cmp_double(const void * a, const void * b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double median(double * v, int n)
+{
+  qsort(v, n, sizeof(double), cmp_double);
+  return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+static void usage(char * prog)
+{
+  fprintf(stderr,
+    "usage: %s [options] [-- pcMatrix options]\n"
+    "  --workers=LIST      worker thread counts (default 1,2,4)\n"
+    "  --buffers=LIST      bounded buffer sizes (default 10,200)\n"
+    "  --matrices=LIST     matrices per run (default 20000)\n"
+    "  --modes=LIST        matrix modes (default 0)\n"
+    "  --repeat=N          runs per configuration (default 5)\n"
+    "  --format=json|csv   output format (default json, one object per line)\n"
+    "  --out=FILE          write results to FILE (default stdout)\n"
+    "  --pcmatrix=PATH     program to run (default ./pcMatrix)\n"
+    "LIST is comma separated, e.g. --workers=1,2,4,8\n", prog);
+}
+
+int main(int argc, char * argv[])
+{
+  sweep_t workers = { 3, { 1, 2, 4 } };
+  sweep_t buffers = { 2, { 10, 200 } };
+  sweep_t matrices = { 1, { 20000 } };
+  sweep_t modes = { 1, { 0 } };
+  int repeat = 5;
+  int csv = 0;
+  FILE * out = stdout;
+
+  static struct option longopts[] = {
+    {"workers",  required_argument, NULL, 'w'},
+    {"buffers",  required_argument, NULL, 'b'},
+    {"matrices", required_argument, NULL, 'n'},
+    {"modes",    required_argument, NULL, 'm'},
+    {"repeat",   required_argument, NULL, 'r'},
+    {"format",   required_argument, NULL, 'f'},
+    {"out",      required_argument, NULL, 'o'},
+    {"pcmatrix", required_argument, NULL, 'p'},
+    {"help",     no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  int longindex = 0;
+  while ((opt = getopt_long(argc, argv, "h", longopts, &longindex)) != -1)
+  {
+    int bad = 0;
+    switch (opt)
+    {
+      case 'w': bad = parse_list(optarg, &workers); break;
+      case 'b': bad = parse_list(optarg, &buffers); break;
+      case 'n': bad = parse_list(optarg, &matrices); break;
+      case 'm': bad = parse_list(optarg, &modes); break;
+      case 'r':
+        repeat = atoi(optarg);
+        bad = (repeat < 1 || repeat > MAX_REPEAT);
+        break;
+      case 'f':
+        csv = (strcmp(optarg, "csv") == 0);
+        bad = !csv && strcmp(optarg, "json") != 0;
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+        if (out == NULL)
+        {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'p': pcmatrix = optarg; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+    if (bad)
+    {
+      fprintf(stderr, "pcbench: bad value for --%s\n", longopts[longindex].name);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  // Anything after "--" goes to pcMatrix
+  for (; optind < argc && nextra < MAX_EXTRA; optind++)
+    extra[nextra++] = argv[optind];
+
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (csv)
+    fprintf(out, "workers,bounded_buffer_size,matrices,matrix_mode,runs,matrices_per_s,"
+                 "mults_per_s,latency_p50_ns,latency_p99_ns,wall_s,cpu_cores,cpu_util,balanced\n");
+
+  for (int im = 0; im < modes.n; im++)
+  for (int in = 0; in < matrices.n; in++)
+  for (int ib = 0; ib < buffers.n; ib++)
+  for (int iw = 0; iw < workers.n; iw++)
+  {
+    double mps[MAX_REPEAT], xps[MAX_REPEAT], p50[MAX_REPEAT], p99[MAX_REPEAT];
+    double wall[MAX_REPEAT], cores[MAX_REPEAT];
+    int runs = 0;
+    int balanced = 1;
+    for (int rep = 0; rep < repeat; rep++)
+    {
+      run_t r;
+      if (run_once(workers.v[iw], buffers.v[ib], matrices.v[in], modes.v[im], &r) != 0)
+        continue;
+      mps[runs] = r.matrices_per_s;
+      xps[runs] = r.mults_per_s;
+      p50[runs] = r.p50_ns;
+      p99[runs] = r.p99_ns;
+      wall[runs] = r.wall_s;
+      cores[runs] = (r.wall_s > 0) ? r.cpu_s / r.wall_s : 0.0;
+      balanced &= r.balanced;
+      runs++;
+    }
+    if (runs == 0)
+      continue;
+
+    double c = median(cores, runs);
+    if (csv)
+      fprintf(out, "%d,%d,%d,%d,%d,%.1f,%.1f,%.0f,%.0f,%.6f,%.3f,%.3f,%d\n",
+              workers.v[iw], buffers.v[ib], matrices.v[in], modes.v[im], runs,
+              median(mps, runs), median(xps, runs), median(p50, runs), median(p99, runs),
+              median(wall, runs), c, c / ncpu, balanced);
+    else
+      fprintf(out, "{\"workers\":%d,\"bounded_buffer_size\":%d,\"matrices\":%d,\"matrix_mode\":%d,"
+                   "\"runs\":%d,\"matrices_per_s\":%.1f,\"mults_per_s\":%.1f,"
+                   "\"latency_p50_ns\":%.0f,\"latency_p99_ns\":%.0f,\"wall_s\":%.6f,"
+                   "\"cpu_cores\":%.3f,\"cpu_util\":%.3f,\"balanced\":%s}\n",
+              workers.v[iw], buffers.v[ib], matrices.v[in], modes.v[im], runs,
+              median(mps, runs), median(xps, runs), median(p50, runs), median(p99, runs),
+              median(wall, runs), c, c / ncpu, balanced ? "true" : "false");
+    fflush(out);
+  }
+
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
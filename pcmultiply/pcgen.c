@@ -0,0 +1,91 @@
+/*
+ *  pcgen module
+ *  Writes matrices from pcMatrix's random generator to a binary stream
+ *
+ *    pcgen [--seed=N] [--mode=M] matrices FILE
+ *
+ *  The records are the matrices one producer with the same seed and
+ *  matrix mode would generate, in order, followed by an index.  Feed the
+ *  file to pcMatrix --input=FILE.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "rng.h"
+#include "mstream.h"
+#include "pcmatrix.h"
+
+static void usage(char * prog)
+{
+  fprintf(stderr, "usage: %s [--seed=N] [--mode=M] matrices FILE\n", prog);
+  fprintf(stderr, "  --seed=N   master random seed (default: current time)\n");
+  fprintf(stderr, "  --mode=M   matrix mode as for pcMatrix (default %d)\n", DEFAULT_MATRIX_MODE);
+}
+
+int main(int argc, char * argv[])
+{
+  static struct option longopts[] = {
+    {"seed", required_argument, NULL, 's'},
+    {"mode", required_argument, NULL, 'm'},
+    {"help", no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  RNG_SEED = (unsigned long long) time(NULL);
+  MATRIX_MODE = DEFAULT_MATRIX_MODE;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", longopts, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        RNG_SEED = strtoull(optarg, NULL, 0);
+        break;
+      case 'm':
+        MATRIX_MODE = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2 || MATRIX_MODE < 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  long count = atol(argv[optind]);
+  char * path = argv[optind + 1];
+
+  rng_master_seed(RNG_SEED);
+  rng_thread_seed(0);
+
+  mstream_writer_t w;
+  if (mstream_create(&w, path) != 0)
+    return 1;
+  for (long i = 0; i < count; i++)
+  {
+    Matrix * mat = GenMatrixRandom();
+    int rc = mstream_write(&w, mat, MSTREAM_TAG_MATRIX);
+    FreeMatrix(mat);
+    if (rc != 0)
+    {
+      perror(path);
+      return 1;
+    }
+  }
+  if (mstream_finish(&w) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+  printf("Wrote %ld matrices in mode %d to %s (seed=%llu)\n", count, MATRIX_MODE, path, RNG_SEED);
+  return 0;
+}
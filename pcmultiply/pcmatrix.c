@@ -34,16 +34,464 @@
 #include <pthread.h>
 #include <assert.h>
 #include <time.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/resource.h>
 #include "matrix.h"
+#include "elem.h"
 #include "counter.h"
 #include "prodcons.h"
+#include "pool.h"
+#include "kernels.h"
+#include "blockmult.h"
+#include "rng.h"
+#include "writer.h"
+#include "hist.h"
+#include "lockstat.h"
+#include "autoscale.h"
+#include "placement.h"
+#include "mstream.h"
+#include "sink.h"
+#include "chain.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "service.h"
 #include "pcmatrix.h"
 
+// Buffer engine names, indexed by ENGINE_*
+static const char * engine_names[] = { "condvar", "lockfree", "shape", "spsc" };
+static const char * wait_names[] = { "condvar", "futex" };
+
+// Kernel instruction set names, indexed by KERNEL_*
+static const char * kernel_names[] = { "auto", "scalar", "sse2", "avx2" };
+
+// Print command line usage
+static void usage(char * prog)
+{
+  fprintf(stderr, "usage: %s [options] [worker_threads [bounded_buffer_size [matricies [matrix_mode]]]]\n", prog);
+  fprintf(stderr, "  --buffer=condvar|lockfree|shape|spsc\n");
+  fprintf(stderr, "                              bounded buffer engine (default condvar)\n");
+  fprintf(stderr, "  --wait=condvar|futex        how the condvar buffer waits: pthread condition\n");
+  fprintf(stderr, "                              variables, or spin then futex (default condvar)\n");
+  fprintf(stderr, "  --batch=N                   matrices per buffer operation (default %d)\n", DEFAULT_BATCH_SIZE);
+  fprintf(stderr, "  --pool                      recycle matrices through per-thread pools\n");
+  fprintf(stderr, "  --kernel=auto|scalar|sse2|avx2\n");
+  fprintf(stderr, "                              matrix kernel instruction set (default auto)\n");
+  fprintf(stderr, "  --elem=i8|i16|i32|i64|f32|f64\n");
+  fprintf(stderr, "                              matrix element type (default i32)\n");
+  fprintf(stderr, "  --parallel-threshold=N      blocked, multi-threaded multiply once a dimension\n");
+  fprintf(stderr, "                              reaches N (default %d)\n", DEFAULT_PARALLEL_THRESHOLD);
+  fprintf(stderr, "  --mult-threads=N            threads per large multiply (default: online CPUs)\n");
+  fprintf(stderr, "  --strassen=N                Strassen-Winograd for square products of order >= N,\n");
+  fprintf(stderr, "                              0 to disable (default %d)\n", DEFAULT_STRASSEN_THRESHOLD);
+  fprintf(stderr, "  --strassen-crossover=N      recurse until quadrants are <= N (default %d)\n",
+          DEFAULT_STRASSEN_CROSSOVER);
+  fprintf(stderr, "  --density=D                 make each generated element nonzero with\n");
+  fprintf(stderr, "                              probability D, 0 < D <= 1 (default 1)\n");
+  fprintf(stderr, "  --sparse-ratio=R            store matrices with at most R of their elements\n");
+  fprintf(stderr, "                              nonzero as CSR, 0 for never (default %.2f)\n", DEFAULT_SPARSE_RATIO);
+  fprintf(stderr, "  --seed=N                    master random seed (default: current time)\n");
+  fprintf(stderr, "  --display=sync|async|quiet|binary\n");
+  fprintf(stderr, "                              how products are printed (default async)\n");
+  fprintf(stderr, "  --quiet                     same as --display=quiet\n");
+  fprintf(stderr, "  --report=FILE               append a JSON summary with latency percentiles\n");
+  fprintf(stderr, "                              to FILE (- for stdout)\n");
+  fprintf(stderr, "  --producers=N               producer threads (default worker_threads)\n");
+  fprintf(stderr, "  --consumers=N               consumer threads (default worker_threads)\n");
+  fprintf(stderr, "  --autoscale[=LOW,HIGH]      park/wake workers to keep the buffer between LOW%%\n");
+  fprintf(stderr, "                              and HIGH%% full (default %d,%d)\n",
+          DEFAULT_AUTOSCALE_LOW, DEFAULT_AUTOSCALE_HIGH);
+  fprintf(stderr, "  --placement=none|smt|l2|l3  pin producer i and consumer i to CPUs sharing a\n");
+  fprintf(stderr, "                              core, L2 or L3; memory on their node (default none)\n");
+  fprintf(stderr, "  --input=FILE                multiply the matrices in a binary stream written by\n");
+  fprintf(stderr, "                              pcgen (matricies and matrix_mode are ignored)\n");
+  fprintf(stderr, "  --output=FILE               write products to FILE as a binary matrix stream\n");
+  fprintf(stderr, "                              instead of displaying them\n");
+  fprintf(stderr, "  --output-records=triples|products\n");
+  fprintf(stderr, "                              left, right and product, or product only (default triples)\n");
+  fprintf(stderr, "  --output-io=mmap|pwrite     how --output reaches the file (default mmap)\n");
+  fprintf(stderr, "  --chain=K                   multiply chains of up to K compatible matrices\n");
+  fprintf(stderr, "                              in their cheapest order instead of pairs\n");
+  fprintf(stderr, "  --verify                    rescan every consumed matrix against its checksum\n");
+  fprintf(stderr, "  --service                   produce until SIGINT/SIGTERM, then drain the buffer;\n");
+  fprintf(stderr, "                              report rates, occupancy and RSS every second\n");
+  fprintf(stderr, "  --service-stats=FILE        write those reports to FILE as JSON lines\n");
+  fprintf(stderr, "  --stats                     print lock wait/hold times and buffer occupancy\n");
+}
+
+// Placement mode names, indexed by PLACE_*
+static const char * placement_names[] = { "none", "smt", "l2", "l3" };
+
+// Display mode names, indexed by DISPLAY_*
+static const char * display_names[] = { "sync", "async", "quiet", "binary" };
+
+// --output file and its record/io choices (SINK_* in sink.h)
+static char * output_path = NULL;
+static int output_records = SINK_TRIPLES;
+static int output_io = SINK_MMAP;
+
+// --input stream, NULL to generate matrices
+static char * input_path = NULL;
+
+// --service-stats destination, NULL for text on stderr
+static char * service_stats_path = NULL;
+
+// Set when --wait was given; the wait statistics are printed then
+static int wait_given = 0;
+
+// Set when --seed was given
+static int seed_given = 0;
+
+// --report destination, "-" for stdout
+static char * report_path = NULL;
+
+// Append one JSON line describing the run, for pcbench and other tools
+static void write_report(char * path, int numw, long long prs, long long cos, long long consmul,
+                         double elapsed, hist_t * latency)
+{
+  FILE * f = (strcmp(path, "-") == 0) ? stdout : fopen(path, "a");
+  if (f == NULL)
+  {
+    perror(path);
+    return;
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(f, "{\"workers\":%d,\"bounded_buffer_size\":%d,\"matrices\":%d,\"matrix_mode\":%d,"
+             "\"producers\":%d,\"consumers\":%d,\"buffer\":\"%s\",\"wait\":\"%s\","
+             "\"elem\":\"%s\",\"batch\":%d,"
+             "\"produced\":%lld,\"consumed\":%lld,\"multiplied\":%lld,\"elapsed_s\":%.6f,"
+             "\"matrices_per_s\":%.1f,\"mults_per_s\":%.1f,"
+             "\"latency_p50_ns\":%llu,\"latency_p99_ns\":%llu,\"latency_mean_ns\":%.0f,"
+             "\"csw_voluntary\":%ld,\"csw_involuntary\":%ld}\n",
+          numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, MATRIX_MODE,
+          NUM_PRODUCERS, NUM_CONSUMERS, engine_names[BUFFER_ENGINE], wait_names[WAIT_STRATEGY],
+          elem_names[ELEM_TYPE], BATCH_SIZE,
+          prs, cos, consmul, elapsed,
+          elapsed > 0 ? cos / elapsed : 0.0, elapsed > 0 ? consmul / elapsed : 0.0,
+          (unsigned long long) hist_percentile(latency, 50.0),
+          (unsigned long long) hist_percentile(latency, 99.0), hist_mean(latency),
+          ru.ru_nvcsw, ru.ru_nivcsw);
+  if (f != stdout)
+    fclose(f);
+}
+
+// Process --options; positional arguments are left at argv[optind..]
+static int parse_options(int argc, char * argv[])
+{
+  static struct option longopts[] = {
+    {"buffer", required_argument, NULL, 'b'},
+    {"wait",   required_argument, NULL, 'w'},
+    {"batch",  required_argument, NULL, 'B'},
+    {"pool",   no_argument,       NULL, 'p'},
+    {"kernel", required_argument, NULL, 'k'},
+    {"elem",   required_argument, NULL, 'E'},
+    {"parallel-threshold", required_argument, NULL, 'T'},
+    {"mult-threads", required_argument, NULL, 'M'},
+    {"strassen", required_argument, NULL, 'W'},
+    {"strassen-crossover", required_argument, NULL, 'X'},
+    {"density", required_argument, NULL, 'D'},
+    {"sparse-ratio", required_argument, NULL, 'Z'},
+    {"seed",   required_argument, NULL, 's'},
+    {"display", required_argument, NULL, 'd'},
+    {"quiet",  no_argument,       NULL, 'q'},
+    {"report", required_argument, NULL, 'r'},
+    {"stats",  no_argument,       NULL, 'S'},
+    {"verify", no_argument,       NULL, 'V'},
+    {"chain",  required_argument, NULL, 'K'},
+    {"producers", required_argument, NULL, 'P'},
+    {"consumers", required_argument, NULL, 'C'},
+    {"autoscale", optional_argument, NULL, 'A'},
+    {"placement", required_argument, NULL, 'L'},
+    {"input",  required_argument, NULL, 'i'},
+    {"output", required_argument, NULL, 'o'},
+    {"output-records", required_argument, NULL, 'R'},
+    {"output-io", required_argument, NULL, 'I'},
+    {"service", no_argument,      NULL, 'Y'},
+    {"service-stats", required_argument, NULL, 'y'},
+    {"help",   no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", longopts, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 'b':
+        BUFFER_ENGINE = -1;
+        for (int i = 0; i < (int) (sizeof(engine_names) / sizeof(engine_names[0])); i++)
+          if (strcmp(optarg, engine_names[i]) == 0)
+            BUFFER_ENGINE = i;
+        if (BUFFER_ENGINE < 0)
+        {
+          fprintf(stderr, "Unknown buffer engine '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'w':
+        WAIT_STRATEGY = -1;
+        for (int i = 0; i < (int) (sizeof(wait_names) / sizeof(wait_names[0])); i++)
+          if (strcmp(optarg, wait_names[i]) == 0)
+            WAIT_STRATEGY = i;
+        if (WAIT_STRATEGY < 0)
+        {
+          fprintf(stderr, "Unknown wait strategy '%s'\n", optarg);
+          return -1;
+        }
+        wait_given = 1;
+        break;
+      case 'B':
+        BATCH_SIZE = atoi(optarg);
+        if (BATCH_SIZE < 1)
+        {
+          fprintf(stderr, "Batch size must be at least 1\n");
+          return -1;
+        }
+        break;
+      case 'p':
+        MATRIX_POOL = 1;
+        break;
+      case 'k':
+        KERNEL_ISA = -1;
+        for (int i = 0; i < (int) (sizeof(kernel_names) / sizeof(kernel_names[0])); i++)
+          if (strcmp(optarg, kernel_names[i]) == 0)
+            KERNEL_ISA = i;
+        if (KERNEL_ISA < 0)
+        {
+          fprintf(stderr, "Unknown kernel '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'E':
+        ELEM_TYPE = elem_lookup(optarg);
+        if (ELEM_TYPE < 0)
+        {
+          fprintf(stderr, "Unknown element type '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'T':
+        PARALLEL_THRESHOLD = atoi(optarg);
+        if (PARALLEL_THRESHOLD < 1)
+        {
+          fprintf(stderr, "Parallel threshold must be at least 1\n");
+          return -1;
+        }
+        break;
+      case 'M':
+        MULT_THREADS = atoi(optarg);
+        break;
+      case 'W':
+        STRASSEN_THRESHOLD = atoi(optarg);
+        if (STRASSEN_THRESHOLD < 0)
+        {
+          fprintf(stderr, "Strassen threshold must be 0 or more\n");
+          return -1;
+        }
+        break;
+      case 'X':
+        STRASSEN_CROSSOVER = atoi(optarg);
+        if (STRASSEN_CROSSOVER < 1)
+        {
+          fprintf(stderr, "Strassen crossover must be at least 1\n");
+          return -1;
+        }
+        break;
+      case 'D':
+        DENSITY = atof(optarg);
+        if (!(DENSITY > 0 && DENSITY <= 1))
+        {
+          fprintf(stderr, "Density must be more than 0 and at most 1\n");
+          return -1;
+        }
+        break;
+      case 'Z':
+        SPARSE_RATIO = atof(optarg);
+        if (!(SPARSE_RATIO >= 0 && SPARSE_RATIO <= 1))
+        {
+          fprintf(stderr, "Sparse ratio must be between 0 and 1\n");
+          return -1;
+        }
+        break;
+      case 's':
+        RNG_SEED = strtoull(optarg, NULL, 0);
+        seed_given = 1;
+        break;
+      case 'd':
+        DISPLAY_MODE = -1;
+        for (int i = 0; i < (int) (sizeof(display_names) / sizeof(display_names[0])); i++)
+          if (strcmp(optarg, display_names[i]) == 0)
+            DISPLAY_MODE = i;
+        if (DISPLAY_MODE < 0)
+        {
+          fprintf(stderr, "Unknown display mode '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'q':
+        DISPLAY_MODE = DISPLAY_QUIET;
+        break;
+      case 'r':
+        report_path = optarg;
+        TRACK_LATENCY = 1;
+        break;
+      case 'K':
+        CHAIN_LENGTH = atoi(optarg);
+        if (CHAIN_LENGTH < 2 || CHAIN_LENGTH > CHAIN_MAX)
+        {
+          fprintf(stderr, "--chain must be between 2 and %d\n", CHAIN_MAX);
+          return -1;
+        }
+        break;
+      case 'V':
+        VERIFY_SUMS = 1;
+        break;
+      case 'S':
+#ifdef PC_STATS
+        LOCK_STATS = 1;
+#else
+        fprintf(stderr, "Built without contention statistics (make STATS=1), ignoring --stats\n");
+#endif
+        break;
+      case 'P':
+        NUM_PRODUCERS = atoi(optarg);
+        if (NUM_PRODUCERS < 1)
+        {
+          fprintf(stderr, "Need at least 1 producer\n");
+          return -1;
+        }
+        break;
+      case 'C':
+        NUM_CONSUMERS = atoi(optarg);
+        if (NUM_CONSUMERS < 1)
+        {
+          fprintf(stderr, "Need at least 1 consumer\n");
+          return -1;
+        }
+        break;
+      case 'A':
+        AUTOSCALE = 1;
+        if (optarg != NULL &&
+            (sscanf(optarg, "%d,%d", &AUTOSCALE_LOW, &AUTOSCALE_HIGH) != 2 ||
+             AUTOSCALE_LOW < 0 || AUTOSCALE_HIGH > 100 || AUTOSCALE_LOW >= AUTOSCALE_HIGH))
+        {
+          fprintf(stderr, "Autoscale watermarks must be LOW,HIGH with 0 <= LOW < HIGH <= 100\n");
+          return -1;
+        }
+        break;
+      case 'i':
+        input_path = optarg;
+        break;
+      case 'Y':
+        SERVICE = 1;
+        break;
+      case 'y':
+        SERVICE = 1;
+        service_stats_path = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        DISPLAY_MODE = DISPLAY_BINARY;
+        break;
+      case 'R':
+        if (strcmp(optarg, "triples") == 0)
+          output_records = SINK_TRIPLES;
+        else if (strcmp(optarg, "products") == 0)
+          output_records = SINK_PRODUCTS;
+        else
+        {
+          fprintf(stderr, "Unknown output records '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'I':
+        if (strcmp(optarg, "mmap") == 0)
+          output_io = SINK_MMAP;
+        else if (strcmp(optarg, "pwrite") == 0)
+          output_io = SINK_PWRITE;
+        else
+        {
+          fprintf(stderr, "Unknown output io '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'L':
+        PLACEMENT = -1;
+        for (int i = 0; i < (int) (sizeof(placement_names) / sizeof(placement_names[0])); i++)
+          if (strcmp(optarg, placement_names[i]) == 0)
+            PLACEMENT = i;
+        if (PLACEMENT < 0)
+        {
+          fprintf(stderr, "Unknown placement '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (DISPLAY_MODE == DISPLAY_BINARY && output_path == NULL)
+  {
+    fprintf(stderr, "--display=binary needs --output=FILE\n");
+    return -1;
+  }
+  // Streams hold 32-bit ints, and a chain multiplies products again, so
+  // they must have the element type of the matrices
+  if (ELEM_TYPE != ELEM_I32 && input_path != NULL)
+  {
+    fprintf(stderr, "--input needs --elem=i32\n");
+    return -1;
+  }
+  if (output_path != NULL && ELEM_TYPE != ELEM_I32 && ELEM_TYPE != ELEM_I8 && ELEM_TYPE != ELEM_I16)
+  {
+    fprintf(stderr, "--output needs --elem=i8, i16 or i32\n");
+    return -1;
+  }
+  if (SERVICE && input_path != NULL)
+  {
+    fprintf(stderr, "--service generates its matrices and cannot take --input\n");
+    return -1;
+  }
+  // CSR matrices are int, and streamed input is used as it is
+  if (DENSITY > 0 && DENSITY < 1 && (ELEM_TYPE != ELEM_I32 || input_path != NULL))
+  {
+    fprintf(stderr, "--density needs --elem=i32 and no --input\n");
+    return -1;
+  }
+  if (CHAIN_LENGTH && elem_products[ELEM_TYPE] != ELEM_TYPE)
+  {
+    fprintf(stderr, "--chain does not work with --elem=%s\n", elem_names[ELEM_TYPE]);
+    return -1;
+  }
+  return 0;
+}
+
 int main (int argc, char * argv[])
 {
+  // Process command line options
+  BUFFER_ENGINE=DEFAULT_BUFFER_ENGINE;
+  BATCH_SIZE=DEFAULT_BATCH_SIZE;
+  MATRIX_POOL=DEFAULT_MATRIX_POOL;
+  KERNEL_ISA=KERNEL_AUTO;
+  PARALLEL_THRESHOLD=DEFAULT_PARALLEL_THRESHOLD;
+  MULT_THREADS=0;
+  STRASSEN_THRESHOLD=DEFAULT_STRASSEN_THRESHOLD;
+  STRASSEN_CROSSOVER=DEFAULT_STRASSEN_CROSSOVER;
+  SPARSE_RATIO=DEFAULT_SPARSE_RATIO;
+  DISPLAY_MODE=DEFAULT_DISPLAY_MODE;
+  AUTOSCALE_LOW=DEFAULT_AUTOSCALE_LOW;
+  AUTOSCALE_HIGH=DEFAULT_AUTOSCALE_HIGH;
+  if (parse_options(argc, argv) != 0)
+    return 1;
+  int nargs = argc - optind + 1;
+  char ** args = argv + optind - 1;
+
   // Process command line arguments
   int numw = NUMWORK;
-  if (argc==1)
+  if (nargs==1)
   {
     BOUNDED_BUFFER_SIZE=MAX;
     NUMBER_OF_MATRICES=LOOPS;
@@ -52,40 +500,61 @@ int main (int argc, char * argv[])
   }
   else
   {
-    if (argc==2)
+    if (nargs==2)
     {
-      numw=atoi(argv[1]);
+      numw=atoi(args[1]);
       BOUNDED_BUFFER_SIZE=MAX;
       NUMBER_OF_MATRICES=LOOPS;
       MATRIX_MODE=DEFAULT_MATRIX_MODE;
     }
-    if (argc==3)
+    if (nargs==3)
     {
-      numw=atoi(argv[1]);
-      BOUNDED_BUFFER_SIZE=atoi(argv[2]);
+      numw=atoi(args[1]);
+      BOUNDED_BUFFER_SIZE=atoi(args[2]);
       NUMBER_OF_MATRICES=LOOPS;
       MATRIX_MODE=DEFAULT_MATRIX_MODE;
     }
-    if (argc==4)
+    if (nargs==4)
     {
-      numw=atoi(argv[1]);
-      BOUNDED_BUFFER_SIZE=atoi(argv[2]);
-      NUMBER_OF_MATRICES=atoi(argv[3]);
+      numw=atoi(args[1]);
+      BOUNDED_BUFFER_SIZE=atoi(args[2]);
+      NUMBER_OF_MATRICES=atoi(args[3]);
       MATRIX_MODE=DEFAULT_MATRIX_MODE;
     }
-    if (argc==5)
+    if (nargs==5)
     {
-      numw=atoi(argv[1]);
-      BOUNDED_BUFFER_SIZE=atoi(argv[2]);
-      NUMBER_OF_MATRICES=atoi(argv[3]);
-      MATRIX_MODE=atoi(argv[4]);
+      numw=atoi(args[1]);
+      BOUNDED_BUFFER_SIZE=atoi(args[2]);
+      NUMBER_OF_MATRICES=atoi(args[3]);
+      MATRIX_MODE=atoi(args[4]);
     }
     printf("USING: worker_threads=%d bounded_buffer_size=%d matricies=%d matrix_mode=%d\n",numw,BOUNDED_BUFFER_SIZE,NUMBER_OF_MATRICES,MATRIX_MODE);
   }
 
-  time_t t;
-  // Seed the random number generator with the system time
-  srand((unsigned) time(&t));
+  // The stream decides how many matrices there are
+  if (input_path != NULL)
+  {
+    if (open_input(input_path) != 0)
+      return 1;
+    printf("Reading %d matrices from %s\n", NUMBER_OF_MATRICES, input_path);
+  }
+
+  if (kernels_init(KERNEL_ISA) != 0)
+  {
+    fprintf(stderr, "This CPU does not support the %s kernels\n", kernel_names[KERNEL_ISA]);
+    return 1;
+  }
+
+  if (MULT_THREADS <= 0)
+    MULT_THREADS = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+  // Seed the per-thread random number generators; --seed makes a run repeatable
+  if (!seed_given)
+  {
+    time_t t;
+    RNG_SEED = (unsigned long long) time(&t);
+  }
+  rng_master_seed(RNG_SEED);
 
   //
   // Demonstration code to show the use of matrix routines
@@ -119,39 +588,73 @@ int main (int argc, char * argv[])
   // return 0;
   // ----------------------------------------------------------
 
-    // Allocate memory for the bounded buffer
-    bigmatrix = (Matrix **) malloc(sizeof(Matrix *) * BOUNDED_BUFFER_SIZE);
-    if (bigmatrix == NULL) {
+    // --producers/--consumers override worker_threads for their side
+    if (NUM_PRODUCERS == 0)
+      NUM_PRODUCERS = numw;
+    if (NUM_CONSUMERS == 0)
+      NUM_CONSUMERS = numw;
+
+    if (PLACEMENT && placement_init(PLACEMENT) != 0) {
+      fprintf(stderr, "Could not read the CPU topology, placement disabled\n");
+      PLACEMENT = PLACE_NONE;
+    }
+
+    // Allocate memory for the bounded buffer, on the first pair's node if placed
+    if (PLACEMENT)
+      placement_prefer_node(placement_buffer_node());
+    if (init_buffer() != 0) {
       fprintf(stderr, "Failed to allocate memory for bounded buffer\n");
       return 1;
     }
+    if (PLACEMENT)
+      placement_prefer_node(-1);
 
 
 
-  printf("Producing %d matrices in mode %d.\n",NUMBER_OF_MATRICES,MATRIX_MODE);
-  printf("Using a shared buffer of size=%d\n", BOUNDED_BUFFER_SIZE);
-  printf("With %d producer and consumer thread(s).\n",numw);
+  if (SERVICE)
+    printf("Producing matrices in mode %d until SIGINT or SIGTERM.\n",MATRIX_MODE);
+  else
+    printf("Producing %d matrices in mode %d.\n",NUMBER_OF_MATRICES,MATRIX_MODE);
+  if (BUFFER_ENGINE == ENGINE_SPSC)
+    printf("Using %d per-producer spsc queues of total size=%d\n", NUM_PRODUCERS, BOUNDED_BUFFER_SIZE);
+  else
+    printf("Using a shared %s buffer of size=%d\n", engine_names[BUFFER_ENGINE], BOUNDED_BUFFER_SIZE);
+  if (NUM_PRODUCERS == NUM_CONSUMERS)
+    printf("With %d producer and consumer thread(s).\n",NUM_PRODUCERS);
+  else
+    printf("With %d producer and %d consumer thread(s).\n",NUM_PRODUCERS,NUM_CONSUMERS);
+  if (AUTOSCALE)
+    printf("Autoscaling to keep the buffer %d%%-%d%% full.\n",AUTOSCALE_LOW,AUTOSCALE_HIGH);
+  printf("Random seed=%llu\n", RNG_SEED);
+  if (ELEM_TYPE != ELEM_I32)
+    printf("Elements are %s (%d byte(s) each), products %s.\n", elem_names[ELEM_TYPE],
+           elem_sizes[ELEM_TYPE], elem_names[elem_products[ELEM_TYPE]]);
+  if (DENSITY > 0 && DENSITY < 1)
+    printf("Element density %.3f, CSR at or below %.3f nonzero.\n", DENSITY, SPARSE_RATIO);
+  if (BATCH_SIZE > 1)
+    printf("Moving up to %d matrices per buffer operation.\n", BATCH_SIZE);
+  placement_report(stdout, NUM_PRODUCERS, NUM_CONSUMERS);
   printf("\n");
 
   // Create arrays of threads for producers and consumers
-  pthread_t *pr = (pthread_t *) malloc(sizeof(pthread_t) * numw);
-  pthread_t *co = (pthread_t *) malloc(sizeof(pthread_t) * numw);
+  pthread_t *pr = (pthread_t *) malloc(sizeof(pthread_t) * NUM_PRODUCERS);
+  pthread_t *co = (pthread_t *) malloc(sizeof(pthread_t) * NUM_CONSUMERS);
 
   if (pr == NULL || co == NULL) {
     fprintf(stderr, "Failed to allocate memory for thread arrays\n");
-    free(bigmatrix);
+    free_buffer();
     if (pr) free(pr);
     if (co) free(co);
     return 1;
   }
 
    // Arrays to store statistics from each thread
-   ProdConsStats **producer_stats = (ProdConsStats **) malloc(sizeof(ProdConsStats *) * numw);
-   ProdConsStats **consumer_stats = (ProdConsStats **) malloc(sizeof(ProdConsStats *) * numw);
+   ProdConsStats **producer_stats = (ProdConsStats **) malloc(sizeof(ProdConsStats *) * NUM_PRODUCERS);
+   ProdConsStats **consumer_stats = (ProdConsStats **) malloc(sizeof(ProdConsStats *) * NUM_CONSUMERS);
 
    if (producer_stats == NULL || consumer_stats == NULL) {
     fprintf(stderr, "Failed to allocate memory for statistics arrays\n");
-    free(bigmatrix);
+    free_buffer();
     free(pr);
     free(co);
     if (producer_stats) free(producer_stats);
@@ -159,15 +662,54 @@ int main (int argc, char * argv[])
     return 1;
   }
 
+  // Start the output writer; anything printf() buffered must go out first
+  fflush(stdout);
+  if (DISPLAY_MODE == DISPLAY_ASYNC && writer_start(STDOUT_FILENO) != 0) {
+    fprintf(stderr, "Failed to create output writer thread\n");
+    DISPLAY_MODE = DISPLAY_SYNC;
+  }
+
+  // Size the output file for every triple up front; it grows if the
+  // matrices come out larger (random mode, --input)
+  if (DISPLAY_MODE == DISPLAY_BINARY) {
+    int d = (MATRIX_MODE > 0) ? MATRIX_MODE : 4;
+    size_t per = MSTREAM_RECORD_SIZE(d, d);
+    if (output_records == SINK_TRIPLES)
+      per *= 3;
+    if (sink_open(output_path, output_records, output_io, per * (size_t) (NUMBER_OF_MATRICES / 2)) != 0) {
+      fprintf(stderr, "Failed to open output file %s\n", output_path);
+      free_buffer();
+      free(pr);
+      free(co);
+      free(producer_stats);
+      free(consumer_stats);
+      return 1;
+    }
+  }
+
+  // Every worker starts active; the controller parks the ones not needed
+  if (AUTOSCALE && autoscale_start(NUM_PRODUCERS, NUM_CONSUMERS, AUTOSCALE_LOW, AUTOSCALE_HIGH) != 0) {
+    fprintf(stderr, "Failed to create autoscale controller thread\n");
+    AUTOSCALE = 0;
+  }
+
+  // From here on a stop signal drains the buffer instead of killing us
+  if (SERVICE && service_start(service_stats_path) != 0) {
+    fprintf(stderr, "Failed to start service mode\n");
+    return 1;
+  }
+
+  uint64_t start_ns = now_ns();
+
   // Create producer threads
-  for (int i = 0; i < numw; i++) {
-    if (pthread_create(&pr[i], NULL, prod_worker, NULL) != 0) {
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    if (pthread_create(&pr[i], NULL, prod_worker, (void *) (intptr_t) i) != 0) {
       fprintf(stderr, "Failed to create producer thread %d\n", i);
       // Clean up already created threads
       for (int j = 0; j < i; j++) {
         pthread_cancel(pr[j]);
       }
-      free(bigmatrix);
+      free_buffer();
       free(pr);
       free(co);
       free(producer_stats);
@@ -177,17 +719,17 @@ int main (int argc, char * argv[])
   }
   
   // Create consumer threads
-  for (int i = 0; i < numw; i++) {
-    if (pthread_create(&co[i], NULL, cons_worker, NULL) != 0) {
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
+    if (pthread_create(&co[i], NULL, cons_worker, (void *) (intptr_t) i) != 0) {
       fprintf(stderr, "Failed to create consumer thread %d\n", i);
       // Clean up already created threads
-      for (int j = 0; j < numw; j++) {
+      for (int j = 0; j < NUM_PRODUCERS; j++) {
         pthread_cancel(pr[j]);
       }
       for (int j = 0; j < i; j++) {
         pthread_cancel(co[j]);
       }
-      free(bigmatrix);
+      free_buffer();
       free(pr);
       free(co);
       free(producer_stats);
@@ -197,26 +739,46 @@ int main (int argc, char * argv[])
   }
 
   // Join producer threads and collect statistics
-  for (int i = 0; i < numw; i++) {
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
     pthread_join(pr[i], (void **)&producer_stats[i]);
   }
 
+  // Parked consumers must be awake to drain the buffer
+  if (AUTOSCALE)
+    autoscale_stop();
+
+  // All producers are done: let consumers drain the buffer and exit
+  close_buffer();
+
   // Join consumer threads and collect statistics
-  for (int i = 0; i < numw; i++) {
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
     pthread_join(co[i], (void **)&consumer_stats[i]);
   }
-  
+
+  // Let the writer finish before the totals are printed after the products
+  if (DISPLAY_MODE == DISPLAY_ASYNC)
+    writer_stop();
+  unsigned long long sink_records = 0, sink_bytes = 0;
+  int sink_rc = 0;
+  if (DISPLAY_MODE == DISPLAY_BINARY)
+    sink_rc = sink_close(&sink_records, &sink_bytes);
+  if (SERVICE)
+    service_stop();
+  double elapsed = (double) (now_ns() - start_ns) / 1e9;
 
 
   // These are used to aggregate total numbers for main thread output
-  int prs = 0; // total #matrices produced
-  int cos = 0; // total #matrices consumed
-  int prodtot = 0; // total sum of elements for matrices produced
-  int constot = 0; // total sum of elements for matrices consumed
-  int consmul = 0; // total # multiplications
+  long long prs = 0; // total #matrices produced
+  long long cos = 0; // total #matrices consumed
+  long long prodtot = 0; // total sum of elements for matrices produced
+  long long constot = 0; // total sum of elements for matrices consumed
+  long long consmul = 0; // total # multiplications
+  long long mismatches = 0; // matrices failing --verify
+  long long chained = 0; // matrices multiplied in chains
+  unsigned long long chain_flops = 0, chain_flops_ltr = 0;
 
   // Combine the stats from all producer threads
-  for (int i = 0; i < numw; i++) {
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
     if (producer_stats[i] != NULL) {
       prs += producer_stats[i]->matrixtotal;
       prodtot += producer_stats[i]->sumtotal;
@@ -224,22 +786,109 @@ int main (int argc, char * argv[])
   }
 
   // Combine the stats from all consumer threads
-  for (int i = 0; i < numw; i++) {
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
     if (consumer_stats[i] != NULL) {
       cos += consumer_stats[i]->matrixtotal;
       constot += consumer_stats[i]->sumtotal;
       consmul += consumer_stats[i]->multtotal;
+      mismatches += consumer_stats[i]->mismatches;
+      chained += consumer_stats[i]->chained;
+      chain_flops += consumer_stats[i]->chain_flops;
+      chain_flops_ltr += consumer_stats[i]->chain_flops_ltr;
     }
   }
 
 
-  printf("Sum of Matrix elements --> Produced=%d = Consumed=%d\n",prodtot,constot);
-  printf("Matrices produced=%d consumed=%d multiplied=%d\n",prs,cos,consmul);
+  printf("Sum of Matrix elements --> Produced=%lld = Consumed=%lld\n",prodtot,constot);
+  printf("Matrices produced=%lld consumed=%lld multiplied=%lld\n",prs,cos,consmul);
+  if (producers_failed())
+    fprintf(stderr, "Production stopped early: a producer ran out of memory\n");
+  if (CHAIN_LENGTH)
+    printf("Chains: %lld products of %.2f matrices on average, %llu scalar multiplies"
+           " vs %llu left to right (%.1f%% saved)\n",
+           consmul, consmul ? (double) chained / consmul : 0.0, chain_flops, chain_flops_ltr,
+           chain_flops_ltr ? 100.0 * (chain_flops_ltr - chain_flops) / chain_flops_ltr : 0.0);
+  if (VERIFY_SUMS)
+    printf("Checksums verified: %lld mismatch(es)\n", mismatches);
+  if (DENSITY > 0 && DENSITY < 1)
+  {
+    sparse_stats_t ss;
+    sparse_stats(&ss);
+    printf("Sparse: %lu of %lu generated matrices stored as CSR, %lu products with a CSR operand"
+           " (%lu stored as CSR)\n", ss.generated_csr, ss.generated, ss.products, ss.products_csr);
+  }
+
+  if (DISPLAY_MODE == DISPLAY_BINARY)
+  {
+    if (sink_rc != 0)
+      fprintf(stderr, "Writing %s failed; the file is incomplete\n", output_path);
+    printf("Binary output: %llu records, %llu bytes to %s\n", sink_records, sink_bytes, output_path);
+  }
+
+  if (wait_given)
+  {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    unsigned long sleeps, spin_hits, wake_calls;
+    buffer_wait_stats(&sleeps, &spin_hits, &wake_calls);
+    if (BUFFER_ENGINE != ENGINE_CONDVAR)
+      printf("Wait %s: only the condvar buffer uses it\n", wait_names[WAIT_STRATEGY]);
+    else if (WAIT_STRATEGY == WAIT_FUTEX)
+      printf("Wait futex: sleeps=%lu spin_hits=%lu wake_calls=%lu\n", sleeps, spin_hits, wake_calls);
+    else
+      printf("Wait condvar: sleeps=%lu wake_calls=%lu\n", sleeps, wake_calls);
+    printf("Context switches: voluntary=%ld involuntary=%ld\n", ru.ru_nvcsw, ru.ru_nivcsw);
+  }
+
+  if (BUFFER_ENGINE == ENGINE_SPSC)
+    printf("SPSC queues: batches stolen=%lu\n", buffer_steals());
+
+  if (AUTOSCALE)
+  {
+    autoscale_stats_t as;
+    autoscale_stats(&as);
+    printf("Autoscale: producers avg=%.2f (%d-%d) consumers avg=%.2f (%d-%d) parks=%lu unparks=%lu\n",
+           as.avg_active[SIDE_PRODUCERS], as.min_active[SIDE_PRODUCERS], as.max_active[SIDE_PRODUCERS],
+           as.avg_active[SIDE_CONSUMERS], as.min_active[SIDE_CONSUMERS], as.max_active[SIDE_CONSUMERS],
+           as.parks, as.unparks);
+  }
+
+  if (LOCK_STATS)
+  {
+    lockstat_print(stdout, BOUNDED_BUFFER_SIZE);
+    lockstat_shutdown();
+  }
+
+  // Stop the multiply helper threads, if any large product started them
+  blocked_shutdown();
+
+  if (MATRIX_POOL)
+  {
+    pool_stats_t ps;
+    pool_stats(&ps);
+    printf("Matrix pool: hits=%lu misses=%lu remote_frees=%lu\n",ps.hits,ps.misses,ps.remote_frees);
+    pool_shutdown();
+  }
+
+  if (report_path != NULL)
+  {
+    hist_t latency;
+    hist_init(&latency);
+    for (int i = 0; i < NUM_CONSUMERS; i++)
+      if (consumer_stats[i] != NULL && consumer_stats[i]->latency != NULL)
+        hist_merge(&latency, consumer_stats[i]->latency);
+    write_report(report_path, numw, prs, cos, consmul, elapsed, &latency);
+  }
 
   // Free memory for statistics
-  for (int i = 0; i < numw; i++) {
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
     if (producer_stats[i] != NULL) free(producer_stats[i]);
-    if (consumer_stats[i] != NULL) free(consumer_stats[i]);
+  }
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
+    if (consumer_stats[i] != NULL) {
+      free(consumer_stats[i]->latency);
+      free(consumer_stats[i]);
+    }
   }
 
     // Free memory for arrays
@@ -247,7 +896,9 @@ int main (int argc, char * argv[])
     free(consumer_stats);
     free(pr);
     free(co);
-    free(bigmatrix);
+    free_buffer();
+    placement_shutdown();
+    close_input();
 
-  return 0;
+  return producers_failed() ? 1 : 0;
 }
@@ -25,3 +25,106 @@ int NUMBER_OF_MATRICES;
 // mode 1-n - Specifies a fixed number of rows and cols with matrix elements of 1
 #define DEFAULT_MATRIX_MODE 0
 int MATRIX_MODE;
+
+// BOUNDED BUFFER ENGINE
+// engine 0 - mutex / condition variable buffer (ch. 30, section 2)
+// engine 1 - lock-free multi-producer/multi-consumer ring
+// engine 2 - buffer partitioned by row count, supports get_compatible()
+// engine 3 - one queue per producer, consumers steal when their own is empty
+#define ENGINE_CONDVAR 0
+#define ENGINE_LOCKFREE 1
+#define ENGINE_SHAPE 2
+#define ENGINE_SPSC 3
+#define DEFAULT_BUFFER_ENGINE ENGINE_CONDVAR
+int BUFFER_ENGINE;
+
+// How the condvar buffer waits when full or empty
+// WAIT_CONDVAR - pthread_cond_wait() on not_full / not_empty
+// WAIT_FUTEX   - adaptive pause spin, then a futex sleep (waitq.h)
+#define WAIT_CONDVAR 0
+#define WAIT_FUTEX 1
+int WAIT_STRATEGY;
+
+// Number of producer and consumer threads (0 = worker_threads)
+int NUM_PRODUCERS;
+int NUM_CONSUMERS;
+
+// Worker sides, for routines that treat producers and consumers alike
+#define SIDE_PRODUCERS 0
+#define SIDE_CONSUMERS 1
+
+// Park and wake workers to keep the buffer between the AUTOSCALE_LOW and
+// AUTOSCALE_HIGH percent watermarks (autoscale.h)
+int AUTOSCALE;
+int AUTOSCALE_LOW;
+int AUTOSCALE_HIGH;
+
+// Matrices moved per put_batch()/get_batch() call by the worker threads
+#define DEFAULT_BATCH_SIZE 1
+int BATCH_SIZE;
+
+// Route AllocMatrix()/FreeMatrix() through the per-thread matrix pool
+#define DEFAULT_MATRIX_POOL 0
+int MATRIX_POOL;
+
+// Instruction set for the matrix kernels (KERNEL_* in kernels.h)
+int KERNEL_ISA;
+
+// Element type of generated matrices (ELEM_* in elem.h, 0 = int)
+int ELEM_TYPE;
+
+// Large products: any dimension >= PARALLEL_THRESHOLD takes the cache-blocked
+// path, split across MULT_THREADS threads (0 = one per online CPU)
+int PARALLEL_THRESHOLD;
+int MULT_THREADS;
+
+// Square products of order >= STRASSEN_THRESHOLD (0 = never) use
+// Strassen-Winograd, recursing until quadrants are <= STRASSEN_CROSSOVER
+int STRASSEN_THRESHOLD;
+int STRASSEN_CROSSOVER;
+
+// Generated elements are nonzero with probability DENSITY (0 = all of
+// them); a matrix with at most SPARSE_RATIO of its elements nonzero is
+// stored as CSR (0 = never)
+double DENSITY;
+double SPARSE_RATIO;
+
+// Master seed for the per-thread random number generators
+unsigned long long RNG_SEED;
+
+// How consumers display each product
+// DISPLAY_SYNC  - printf() under stdout_mutex, one consumer at a time
+// DISPLAY_ASYNC - format into per-thread buffers written by a writer thread
+// DISPLAY_QUIET - no product output, totals only
+// DISPLAY_BINARY - records in a binary matrix stream file (sink.h, --output)
+#define DISPLAY_SYNC 0
+#define DISPLAY_ASYNC 1
+#define DISPLAY_QUIET 2
+#define DISPLAY_BINARY 3
+#define DEFAULT_DISPLAY_MODE DISPLAY_ASYNC
+int DISPLAY_MODE;
+
+// Record per-matrix latency (generation to its product being displayed);
+// set by --report
+int TRACK_LATENCY;
+
+// Record lock and buffer contention statistics (lockstat.h); set by --stats
+int LOCK_STATS;
+
+// Consumers multiply chains of up to this many compatible matrices in
+// their cheapest order (chain.h) instead of pairs; 0 for pairs, set by --chain
+int CHAIN_LENGTH;
+
+// Consumers rescan every matrix and compare with its checksum; set by --verify
+int VERIFY_SUMS;
+
+// Pin producer/consumer pairs to CPUs sharing a core or cache (PLACE_* in
+// placement.h) and keep their memory on the local NUMA node
+int PLACEMENT;
+
+// Producers take zero-copy views of a mapped matrix stream (mstream.h,
+// --input) instead of generating random matrices
+int INPUT_STREAM;
+
+// Produce until SIGINT/SIGTERM instead of NUMBER_OF_MATRICES (service.h)
+int SERVICE;
@@ -0,0 +1,283 @@
+/*
+ *  Thread placement routines
+ *
+ *  CPUs are grouped into domains by the sysfs CPU list naming the CPUs
+ *  they share a core or cache with.  When a domain cannot be read (no
+ *  SMT, no cache directory) the CPU's package is used instead, and
+ *  failing that each CPU is its own domain.  Within a domain CPUs are
+ *  paired in order; an odd one out hosts both halves of a pair.
+ *
+ *  Memory placement uses the set_mempolicy(2) system call directly, so
+ *  no NUMA library is needed.  MPOL_PREFERRED falls back to other nodes
+ *  when the preferred one is full instead of failing the allocation.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "placement.h"
+#include "pcmatrix.h"
+
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+
+static const char * mode_names[] = { "none", "smt", "l2", "l3" };
+
+static place_pair_t * pairs = NULL;
+static int npairs = 0;
+static int ndomains = 0;
+static int place_mode = PLACE_NONE;
+
+// Read the first line of a sysfs file into buf; -1 if it does not exist
+static int read_line(const char *path, char *buf, size_t len)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+  if (fgets(buf, (int) len, f) == NULL)
+    buf[0] = '\0';
+  fclose(f);
+  buf[strcspn(buf, "\n")] = '\0';
+  return 0;
+}
+
+// Parse a CPU list such as "0-3,8,10-11" into cpus[]; returns the count
+static int parse_cpu_list(const char *s, int *cpus, int max)
+{
+  int n = 0;
+  while (*s != '\0' && n < max)
+  {
+    char *end;
+    long lo = strtol(s, &end, 10);
+    if (end == s)
+      break;
+    long hi = lo;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (long c = lo; c <= hi && n < max; c++)
+      cpus[n++] = (int) c;
+    s = (*end == ',') ? end + 1 : end;
+  }
+  return n;
+}
+
+// NUMA node of cpu: the nodeN entry in its sysfs directory
+static int cpu_node(int cpu)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/cpu%d", PLACEMENT_SYSFS, cpu);
+  DIR *d = opendir(path);
+  if (d == NULL)
+    return -1;
+  int node = -1;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL)
+    if (strncmp(e->d_name, "node", 4) == 0 && sscanf(e->d_name + 4, "%d", &node) == 1)
+      break;
+  closedir(d);
+  return node;
+}
+
+// The CPU list naming cpu's domain for mode, written to key
+static void domain_key(int cpu, int mode, char *key, size_t len)
+{
+  char path[256];
+  key[0] = '\0';
+  if (mode == PLACE_SMT)
+  {
+    snprintf(path, sizeof(path), "%s/cpu%d/topology/thread_siblings_list", PLACEMENT_SYSFS, cpu);
+    if (read_line(path, key, len) == 0)
+      return;
+  }
+  else
+  {
+    // cache/indexN for the wanted level, skipping instruction caches
+    int level = (mode == PLACE_L2) ? 2 : 3;
+    for (int i = 0; ; i++)
+    {
+      char buf[64];
+      snprintf(path, sizeof(path), "%s/cpu%d/cache/index%d/level", PLACEMENT_SYSFS, cpu, i);
+      if (read_line(path, buf, sizeof(buf)) != 0)
+        break;
+      if (atoi(buf) != level)
+        continue;
+      snprintf(path, sizeof(path), "%s/cpu%d/cache/index%d/type", PLACEMENT_SYSFS, cpu, i);
+      if (read_line(path, buf, sizeof(buf)) == 0 && strcmp(buf, "Instruction") == 0)
+        continue;
+      snprintf(path, sizeof(path), "%s/cpu%d/cache/index%d/shared_cpu_list", PLACEMENT_SYSFS, cpu, i);
+      if (read_line(path, key, len) == 0)
+        return;
+    }
+  }
+  snprintf(path, sizeof(path), "%s/cpu%d/topology/physical_package_id", PLACEMENT_SYSFS, cpu);
+  if (read_line(path, key, len) == 0)
+  {
+    // Keep a package id apart from a CPU list such as "0"
+    memmove(key + 1, key, strlen(key) + 1);
+    key[0] = 'p';
+    return;
+  }
+  snprintf(key, len, "cpu%d", cpu);
+}
+
+// Read the topology and build the pair list for mode; -1 if no usable CPU
+int placement_init(int mode)
+{
+  place_mode = mode;
+  if (mode == PLACE_NONE)
+    return 0;
+
+  char path[256];
+  char line[1024];
+  static int online[PLACEMENT_MAX_CPUS];
+  snprintf(path, sizeof(path), "%s/online", PLACEMENT_SYSFS);
+  if (read_line(path, line, sizeof(line)) != 0)
+    return -1;
+  int nonline = parse_cpu_list(line, online, PLACEMENT_MAX_CPUS);
+
+  // Only CPUs this process may run on
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    CPU_ZERO(&allowed);
+  int ncpus = 0;
+  int cpus[PLACEMENT_MAX_CPUS];
+  for (int i = 0; i < nonline; i++)
+    if (online[i] < CPU_SETSIZE && CPU_ISSET(online[i], &allowed))
+      cpus[ncpus++] = online[i];
+  if (ncpus == 0)
+    return -1;
+
+  // Group the CPUs into domains, in order of each domain's first CPU
+  char (*keys)[256] = malloc(sizeof(*keys) * ncpus);
+  int *domain_of = malloc(sizeof(int) * ncpus);
+  pairs = malloc(sizeof(place_pair_t) * ncpus);
+  if (keys == NULL || domain_of == NULL || pairs == NULL)
+  {
+    free(keys);
+    free(domain_of);
+    free(pairs);
+    pairs = NULL;
+    return -1;
+  }
+  ndomains = 0;
+  for (int i = 0; i < ncpus; i++)
+  {
+    char key[256];
+    domain_key(cpus[i], mode, key, sizeof(key));
+    int d;
+    for (d = 0; d < ndomains; d++)
+      if (strcmp(keys[d], key) == 0)
+        break;
+    if (d == ndomains)
+      strcpy(keys[ndomains++], key);
+    domain_of[i] = d;
+  }
+
+  // Pair CPUs within each domain, dealing pairs round-robin across domains
+  int *next = calloc(ndomains, sizeof(int));   // position scanned so far, per domain
+  npairs = 0;
+  for (int progress = 1; progress && next != NULL; )
+  {
+    progress = 0;
+    for (int d = 0; d < ndomains; d++)
+    {
+      int a = -1, b = -1;
+      int i = next[d];
+      for (; i < ncpus && b < 0; i++)
+      {
+        if (domain_of[i] != d)
+          continue;
+        if (a < 0)
+          a = i;
+        else
+          b = i;
+      }
+      next[d] = i;
+      if (a < 0)
+        continue;
+      pairs[npairs].producer_cpu = cpus[a];
+      pairs[npairs].consumer_cpu = cpus[b < 0 ? a : b];
+      pairs[npairs].node = cpu_node(cpus[a]);
+      pairs[npairs].domain = d;
+      npairs++;
+      progress = 1;
+    }
+  }
+  free(next);
+  free(keys);
+  free(domain_of);
+  return (npairs > 0) ? 0 : -1;
+}
+
+// Print which CPU every producer and consumer will run on
+void placement_report(FILE *f, int producers, int consumers)
+{
+  if (place_mode == PLACE_NONE || npairs == 0)
+    return;
+  fprintf(f, "Placement %s: %d pair slot(s) in %d domain(s)\n",
+          mode_names[place_mode], npairs, ndomains);
+  int n = (producers > consumers) ? producers : consumers;
+  for (int i = 0; i < n; i++)
+  {
+    place_pair_t *p = &pairs[i % npairs];
+    fprintf(f, "  pair %d:", i);
+    if (i < producers)
+      fprintf(f, " producer cpu %d", p->producer_cpu);
+    if (i < consumers)
+      fprintf(f, "%s consumer cpu %d", (i < producers) ? "," : "", p->consumer_cpu);
+    fprintf(f, "  (domain %d, node %d)\n", p->domain, p->node);
+  }
+  if (placement_buffer_node() >= 0)
+    fprintf(f, "  buffer memory on node %d\n", placement_buffer_node());
+}
+
+// Prefer node for the calling thread's future page allocations; -1 resets
+void placement_prefer_node(int node)
+{
+  unsigned long mask = 0;
+  if (node < 0 || node >= (int) (8 * sizeof(mask)))
+  {
+    syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    return;
+  }
+  mask = 1UL << node;
+  syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1);
+}
+
+// Pin the calling worker (index of side) to its pair's CPU and keep the
+// memory it allocates on that CPU's node
+void placement_apply(int side, int index)
+{
+  if (place_mode == PLACE_NONE || npairs == 0)
+    return;
+  place_pair_t *p = &pairs[index % npairs];
+  int cpu = (side == SIDE_PRODUCERS) ? p->producer_cpu : p->consumer_cpu;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  placement_prefer_node(p->node);
+}
+
+// Node the shared buffer is allocated on: the first pair's, where the
+// first handoffs happen
+int placement_buffer_node()
+{
+  return (place_mode == PLACE_NONE || npairs == 0) ? -1 : pairs[0].node;
+}
+
+void placement_shutdown()
+{
+  free(pairs);
+  pairs = NULL;
+  npairs = 0;
+}
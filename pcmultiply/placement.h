@@ -0,0 +1,51 @@
+/*
+ *  placement header
+ *  Function prototypes, data, and constants for the thread placement module
+ *
+ *  Pins producer i and consumer i as a pair onto CPUs that share a
+ *  hardware domain, so the matrices handed between them stay in a cache
+ *  both can reach (with --buffer=spsc, consumer i drains producer i's
+ *  queue first).  Pairs are dealt round-robin across the domains, so a
+ *  few workers spread out before any domain is doubled up.  Each pinned
+ *  worker prefers its CPU's NUMA node for new memory, which puts the
+ *  matrices it allocates on its own node.
+ *
+ *  The topology comes from PLACEMENT_SYSFS (/sys/devices/system/cpu).
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#ifndef PLACEMENT_SYSFS
+#define PLACEMENT_SYSFS "/sys/devices/system/cpu"
+#endif
+
+#define PLACEMENT_MAX_CPUS 1024
+
+// Placement modes - the domain a producer/consumer pair shares
+// PLACE_NONE - leave placement to the scheduler
+// PLACE_SMT  - hardware threads of one core (thread_siblings_list)
+// PLACE_L2   - CPUs sharing an L2 cache
+// PLACE_L3   - CPUs sharing the last-level (L3) cache
+#define PLACE_NONE 0
+#define PLACE_SMT 1
+#define PLACE_L2 2
+#define PLACE_L3 3
+
+// THREAD PLACEMENT
+
+// one producer/consumer pair; both CPUs are in the same domain
+typedef struct __place_pair_t {
+  int producer_cpu;
+  int consumer_cpu;
+  int node;          // NUMA node of producer_cpu, -1 if unknown
+  int domain;        // index into the domain list
+} place_pair_t;
+
+// placement methods
+int placement_init(int mode);
+void placement_report(FILE *f, int producers, int consumers);
+void placement_apply(int side, int index);
+void placement_prefer_node(int node);
+int placement_buffer_node();
+void placement_shutdown();
@@ -0,0 +1,214 @@
+/*
+ *  Matrix pool routines
+ *
+ *  Recycles matrices by shape so the steady state of a run does no
+ *  malloc/free at all.  hits counts allocations served from a pool,
+ *  misses counts allocations that had to call malloc.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "pool.h"
+
+// This thread's pool, created on first use
+static __thread matrix_pool_t * my_pool = NULL;
+
+// Every pool ever created, so pool_stats()/pool_shutdown() can reach
+// pools of threads that have already exited
+static matrix_pool_t * all_pools = NULL;
+static pthread_mutex_t pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static matrix_pool_t * this_pool()
+{
+  if (my_pool == NULL)
+  {
+    my_pool = (matrix_pool_t *) aligned_alloc(64, sizeof(matrix_pool_t));
+    if (my_pool == NULL)
+      return NULL;
+    for (int i = 0; i < POOL_BUCKETS; i++)
+    {
+      my_pool->buckets[i].rows = 0;
+      my_pool->buckets[i].cols = 0;
+      my_pool->buckets[i].elem = 0;
+      my_pool->buckets[i].head = NULL;
+    }
+    my_pool->cached = 0;
+    my_pool->hits = 0;
+    my_pool->misses = 0;
+    my_pool->remote_frees = 0;
+    atomic_init(&my_pool->returned, NULL);
+
+    pthread_mutex_lock(&pools_mutex);
+    my_pool->next_pool = all_pools;
+    all_pools = my_pool;
+    pthread_mutex_unlock(&pools_mutex);
+  }
+  return my_pool;
+}
+
+// Find the bucket for a shape and element type, claiming an unused one if
+// create is set.  Returns NULL if the shape has no bucket (and none could
+// be claimed).
+static pool_bucket_t * find_bucket(matrix_pool_t * p, int r, int c, int elem, int create)
+{
+  unsigned h = (((unsigned) r * 31u + (unsigned) c) * 7u + (unsigned) elem) & (POOL_BUCKETS - 1);
+  for (int i = 0; i < POOL_BUCKETS; i++)
+  {
+    pool_bucket_t * b = &p->buckets[(h + i) & (POOL_BUCKETS - 1)];
+    if (b->rows == r && b->cols == c && b->elem == elem)
+      return b;
+    if (b->rows == 0)
+    {
+      if (!create)
+        return NULL;
+      b->rows = r;
+      b->cols = c;
+      b->elem = elem;
+      return b;
+    }
+  }
+  return NULL;
+}
+
+// Put a matrix on the owner's local free list (owner thread only)
+static void local_put(matrix_pool_t * p, Matrix * mat)
+{
+  pool_bucket_t * b = NULL;
+  if (p->cached < POOL_MAX_CACHED)
+    b = find_bucket(p, mat->rows, mat->cols, mat->elem, 1);
+  if (b == NULL)
+  {
+    free(mat);
+    return;
+  }
+  mat->next = b->head;
+  b->head = mat;
+  p->cached++;
+}
+
+// Move everything other threads have returned onto the local lists
+static void drain_returned(matrix_pool_t * p)
+{
+  Matrix * mat = atomic_exchange_explicit(&p->returned, NULL, memory_order_acquire);
+  while (mat != NULL)
+  {
+    Matrix * next = mat->next;
+    local_put(p, mat);
+    mat = next;
+  }
+}
+
+static Matrix * take(matrix_pool_t * p, int r, int c, int elem)
+{
+  pool_bucket_t * b = find_bucket(p, r, c, elem, 0);
+  if (b == NULL || b->head == NULL)
+    return NULL;
+  Matrix * mat = b->head;
+  b->head = mat->next;
+  p->cached--;
+  return mat;
+}
+
+Matrix * pool_alloc(int r, int c, int elem)
+{
+  matrix_pool_t * p = this_pool();
+  if (p == NULL)
+    return NewMatrixElem(r, c, elem);
+
+  Matrix * mat = take(p, r, c, elem);
+  if (mat == NULL && atomic_load_explicit(&p->returned, memory_order_relaxed) != NULL)
+  {
+    drain_returned(p);
+    mat = take(p, r, c, elem);
+  }
+  if (mat != NULL)
+  {
+    p->hits++;
+    mat->next = NULL;
+    return mat;
+  }
+
+  p->misses++;
+  mat = NewMatrixElem(r, c, elem);
+  mat->pool = p;
+  return mat;
+}
+
+void pool_free(Matrix * mat)
+{
+  matrix_pool_t * owner = mat->pool;
+  if (owner == my_pool)
+  {
+    local_put(owner, mat);
+    return;
+  }
+
+  // Lock-free push onto the owner's return stack.  Only the owner pops,
+  // and it takes the whole stack at once, so there is no ABA hazard.
+  Matrix * head = atomic_load_explicit(&owner->returned, memory_order_relaxed);
+  do
+  {
+    mat->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&owner->returned, &head, mat,
+             memory_order_release, memory_order_relaxed));
+
+  matrix_pool_t * p = this_pool();
+  if (p != NULL)
+    p->remote_frees++;
+}
+
+// Sum the counters of every pool; call once worker threads are joined
+void pool_stats(pool_stats_t * stats)
+{
+  stats->hits = 0;
+  stats->misses = 0;
+  stats->remote_frees = 0;
+  pthread_mutex_lock(&pools_mutex);
+  for (matrix_pool_t * p = all_pools; p != NULL; p = p->next_pool)
+  {
+    stats->hits += p->hits;
+    stats->misses += p->misses;
+    stats->remote_frees += p->remote_frees;
+  }
+  pthread_mutex_unlock(&pools_mutex);
+}
+
+// Release every pooled matrix and every pool; call once all threads are joined
+void pool_shutdown()
+{
+  pthread_mutex_lock(&pools_mutex);
+  matrix_pool_t * p = all_pools;
+  all_pools = NULL;
+  pthread_mutex_unlock(&pools_mutex);
+
+  while (p != NULL)
+  {
+    matrix_pool_t * next_pool = p->next_pool;
+    Matrix * mat = atomic_exchange(&p->returned, NULL);
+    while (mat != NULL)
+    {
+      Matrix * next = mat->next;
+      free(mat);
+      mat = next;
+    }
+    for (int i = 0; i < POOL_BUCKETS; i++)
+    {
+      mat = p->buckets[i].head;
+      while (mat != NULL)
+      {
+        Matrix * next = mat->next;
+        free(mat);
+        mat = next;
+      }
+    }
+    free(p);
+    p = next_pool;
+  }
+  my_pool = NULL;
+}
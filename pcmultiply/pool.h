@@ -0,0 +1,55 @@
+/*
+ *  pool header
+ *  Function prototypes, data, and constants for the matrix pool module
+ *
+ *  Each thread owns a pool of free matrices bucketed by shape.  A matrix
+ *  freed by its owner goes straight back on a local free list; a matrix
+ *  freed by any other thread is pushed onto the owner's lock-free return
+ *  stack, which the owner drains when its local lists run dry.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdatomic.h>
+
+// Shape buckets per thread (power of two, open addressing)
+#define POOL_BUCKETS 64
+
+// Free matrices a thread keeps before handing extras back to free()
+#define POOL_MAX_CACHED 4096
+
+// MATRIX POOL
+
+// free list for one (rows, cols, elem) shape; rows == 0 marks an unused bucket
+typedef struct __pool_bucket_t {
+  int rows;
+  int cols;
+  int elem;
+  Matrix * head;
+} pool_bucket_t;
+
+// per-thread pool - the return stack sits on its own cache line since
+// other threads write to it
+typedef struct matrix_pool {
+  pool_bucket_t buckets[POOL_BUCKETS];
+  int cached;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long remote_frees;
+  struct matrix_pool * next_pool;
+  _Alignas(64) _Atomic(Matrix *) returned;
+} matrix_pool_t;
+
+// totals across all pools
+typedef struct __pool_stats_t {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long remote_frees;
+} pool_stats_t;
+
+// pool methods
+Matrix * pool_alloc(int r, int c, int elem);
+void pool_free(Matrix * mat);
+void pool_stats(pool_stats_t * stats);
+void pool_shutdown();
@@ -13,10 +13,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
 #include "counter.h"
 #include "matrix.h"
 #include "pcmatrix.h"
 #include "prodcons.h"
+#include "ring.h"
+#include "shapebuf.h"
+#include "spsc.h"
+#include "rng.h"
+#include "writer.h"
+#include "hist.h"
+#include "lockstat.h"
+#include "autoscale.h"
+#include "placement.h"
+#include "mstream.h"
+#include "sink.h"
+#include "chain.h"
+#include "waitq.h"
+#include "service.h"
 
 // Define Locks, Condition variables, and so on here
 pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -28,22 +45,157 @@ pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 int in = 0; // Next index to produce into
 int out = 0; // Next index to consume from
 int count = 0; // Number of matrices currently in buffer
+int closed = 0; // Set once producers are done, lets get() drain and return NULL
 
-// Global counters for production and consumption
-int globalProduced = 0;
-int globalConsumed = 0;
-pthread_mutex_t global_counter_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Spin-then-futex stand-ins for not_full / not_empty when WAIT_STRATEGY == WAIT_FUTEX
+waitq_t not_full_q;
+waitq_t not_empty_q;
+
+// Lock-free ring used instead of the above when BUFFER_ENGINE == ENGINE_LOCKFREE
+ring_t ring;
+
+// Shape-indexed buffer used instead when BUFFER_ENGINE == ENGINE_SHAPE
+shapebuf_t shapebuf;
+
+// Per-producer queues used instead when BUFFER_ENGINE == ENGINE_SPSC
+spsc_t spsc;
+
+// Matrix stream read by the producers when INPUT_STREAM is set
+mstream_t input_stream;
+
+// Index of the calling worker among the producers or the consumers; picks
+// the ENGINE_SPSC queue to fill or to drain first
+static __thread int worker_index = 0;
+
+// Global production quota and consumption counter (counter.h); neither
+// takes a lock, producers claim BATCH_SIZE matrices per atomic
+quota_t globalProduced;
+counter_t globalConsumed;
+
+// Products made so far, for reports taken while the run is going
+counter_t globalMultiplied;
+
+// Set by a producer that could not allocate; every producer then stops
+// claiming matrices and the run drains and ends as usual
+static atomic_int producer_failed;
+
+// Map the input stream; producers then hand out its records instead of
+// generating matrices, and NUMBER_OF_MATRICES becomes the record count
+int open_input(const char *path)
+{
+    if (mstream_open(&input_stream, path) != 0)
+        return -1;
+    if (input_stream.count > INT_MAX) {
+        fprintf(stderr, "%s: %llu records, at most %d can be read\n",
+                path, (unsigned long long) input_stream.count, INT_MAX);
+        mstream_close(&input_stream);
+        return -1;
+    }
+    INPUT_STREAM = 1;
+    NUMBER_OF_MATRICES = (int) input_stream.count;
+    return 0;
+}
+
+// Unmap the input stream, once every view of it has been freed
+void close_input()
+{
+    if (INPUT_STREAM)
+        mstream_close(&input_stream);
+}
+
+// Allocate storage for the selected buffer engine
+int init_buffer()
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE)
+        return ring_init(&ring, BOUNDED_BUFFER_SIZE);
+    if (BUFFER_ENGINE == ENGINE_SHAPE)
+        return shapebuf_init(&shapebuf, BOUNDED_BUFFER_SIZE);
+    if (BUFFER_ENGINE == ENGINE_SPSC) {
+        // Every producer's queue needs at least one slot
+        if (BOUNDED_BUFFER_SIZE < NUM_PRODUCERS) {
+            fprintf(stderr, "The spsc buffer needs bounded_buffer_size >= %d (one slot per producer)\n",
+                    NUM_PRODUCERS);
+            return -1;
+        }
+        return spsc_init(&spsc, NUM_PRODUCERS, BOUNDED_BUFFER_SIZE);
+    }
+
+    waitq_init(&not_full_q);
+    waitq_init(&not_empty_q);
+    bigmatrix = (Matrix **) malloc(sizeof(Matrix *) * BOUNDED_BUFFER_SIZE);
+    return (bigmatrix == NULL) ? -1 : 0;
+}
+
+// Wait for the condvar buffer to change, on cond or on its waitq per
+// WAIT_STRATEGY; buffer_mutex is held on entry and on return
+static void buffer_wait(pthread_cond_t *c, waitq_t *q, int cond)
+{
+    if (WAIT_STRATEGY == WAIT_FUTEX) {
+        STAT_WAIT_BEGIN(cond, STAT_BUFFER_MUTEX);
+        waitq_wait(q, &buffer_mutex);
+        STAT_WAIT_END(cond, STAT_BUFFER_MUTEX);
+        return;
+    }
+    STAT_COND_WAIT(c, &buffer_mutex, cond, STAT_BUFFER_MUTEX);
+    atomic_fetch_add_explicit(&q->sleeps, 1, memory_order_relaxed);
+}
+
+// Wake one waiter, or all of them, on cond or on its waitq.  A waitq
+// counts its FUTEX_WAKE calls; every signal or broadcast is counted here
+static void buffer_wake(pthread_cond_t *c, waitq_t *q, int all)
+{
+    if (WAIT_STRATEGY == WAIT_FUTEX) {
+        waitq_wake(q, all ? WAITQ_ALL : 1);
+        return;
+    }
+    atomic_fetch_add_explicit(&q->wake_calls, 1, memory_order_relaxed);
+    if (all)
+        pthread_cond_broadcast(c);
+    else
+        pthread_cond_signal(c);
+}
+
+// Sleeps, spin hits and wake calls (FUTEX_WAKE calls, or condvar signals
+// and broadcasts) of both buffer conditions (ENGINE_CONDVAR); spin hits
+// stay 0 under WAIT_CONDVAR
+void buffer_wait_stats(unsigned long *sleeps, unsigned long *spin_hits, unsigned long *wake_calls)
+{
+    *sleeps = atomic_load(&not_full_q.sleeps) + atomic_load(&not_empty_q.sleeps);
+    *spin_hits = atomic_load(&not_full_q.spin_hits) + atomic_load(&not_empty_q.spin_hits);
+    *wake_calls = atomic_load(&not_full_q.wake_calls) + atomic_load(&not_empty_q.wake_calls);
+}
+
+void free_buffer()
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE)
+        ring_destroy(&ring);
+    else if (BUFFER_ENGINE == ENGINE_SHAPE)
+        shapebuf_destroy(&shapebuf);
+    else if (BUFFER_ENGINE == ENGINE_SPSC)
+        spsc_destroy(&spsc);
+    else
+        free(bigmatrix);
+}
 
 // Bounded buffer put() get()
 int put(Matrix * value)
 {
+	if (BUFFER_ENGINE == ENGINE_LOCKFREE)
+		return ring_put(&ring, value);
+	if (BUFFER_ENGINE == ENGINE_SHAPE)
+		return (shapebuf_put_batch(&shapebuf, &value, 1) == 1) ? 0 : -1;
+	if (BUFFER_ENGINE == ENGINE_SPSC)
+		return (spsc_put_batch(&spsc, worker_index, &value, 1) == 1) ? 0 : -1;
+
 	// Lock the buffer for exclusive access
-	pthread_mutex_lock(&buffer_mutex);
+	STAT_LOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
 
 	// If the buffer is full, wait until a consumer removes an item
 	while (count == BOUNDED_BUFFER_SIZE) {
-		pthread_cond_wait(&not_full, &buffer_mutex);
+		buffer_wait(&not_full, &not_full_q, STAT_NOT_FULL);
 	}
+	STAT_WAIT_DONE(STAT_NOT_FULL);
+	STAT_OCCUPANCY(count);
 
 	// Insert matrix pointer into buffer at 'in'
 	bigmatrix[in] = value;
@@ -55,10 +207,10 @@ int put(Matrix * value)
 	count++;
 
 	// Signal that there is at least one item available for consumers
-	pthread_cond_signal(&not_empty);
+	buffer_wake(&not_empty, &not_empty_q, 0);
 
 	// Unlock the buffer
-	pthread_mutex_unlock(&buffer_mutex);
+	STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
 
 	// Success
 	return 0;
@@ -66,22 +218,32 @@ int put(Matrix * value)
 
 Matrix * get()
 {
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE)
+        return ring_get(&ring);
+    if (BUFFER_ENGINE == ENGINE_SHAPE) {
+        Matrix *value;
+        return (shapebuf_get_batch(&shapebuf, &value, 1) == 1) ? value : NULL;
+    }
+    if (BUFFER_ENGINE == ENGINE_SPSC) {
+        Matrix *value;
+        return (spsc_get_batch(&spsc, worker_index, &value, 1) == 1) ? value : NULL;
+    }
+
     // Lock the buffer for exclusive access
-    pthread_mutex_lock(&buffer_mutex);
+    STAT_LOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
 
     while (count == 0) {
-        // Check if production has finished, preventing an infinite wait
-        pthread_mutex_lock(&global_counter_mutex);
-        int finished = (globalProduced >= NUMBER_OF_MATRICES);
-        pthread_mutex_unlock(&global_counter_mutex);
-
-        if (finished) {
-            pthread_mutex_unlock(&buffer_mutex);
+        // Once producers have closed the buffer and it is drained, we are done
+        if (closed) {
+            STAT_WAIT_DONE(STAT_NOT_EMPTY);
+            STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
             return NULL; // Return NULL to signal that no more matrices will be produced
         }
 
-        pthread_cond_wait(&not_empty, &buffer_mutex);
+        buffer_wait(&not_empty, &not_empty_q, STAT_NOT_EMPTY);
     }
+    STAT_WAIT_DONE(STAT_NOT_EMPTY);
+    STAT_OCCUPANCY(count);
 
     // Get matrix pointer from buffer at 'out'
     Matrix *value = bigmatrix[out];
@@ -93,136 +255,518 @@ Matrix * get()
     count--;
 
     // Signal that there is space available for producers
-    pthread_cond_signal(&not_full);
+    buffer_wake(&not_full, &not_full_q, 0);
 
     // Unlock the buffer
-    pthread_mutex_unlock(&buffer_mutex);
+    STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
 
     // Return the matrix pointer
     return value;
 }
 
-// Matrix PRODUCER worker thread
+// Insert n matrices, taking the lock once per run of free slots.
+// Consumers are woken once per run rather than once per matrix.
+int put_batch(Matrix ** values, int n)
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE) {
+        for (int i = 0; i < n; i++)
+            ring_put(&ring, values[i]);
+        return n;
+    }
+    if (BUFFER_ENGINE == ENGINE_SHAPE)
+        return shapebuf_put_batch(&shapebuf, values, n);
+    if (BUFFER_ENGINE == ENGINE_SPSC)
+        return spsc_put_batch(&spsc, worker_index, values, n);
+
+    int done = 0;
+    STAT_LOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
+    while (done < n) {
+        // Wait for at least one free slot
+        while (count == BOUNDED_BUFFER_SIZE) {
+            buffer_wait(&not_full, &not_full_q, STAT_NOT_FULL);
+        }
+        STAT_OCCUPANCY(count);
+
+        // Copy as many as fit
+        int k = BOUNDED_BUFFER_SIZE - count;
+        if (k > n - done)
+            k = n - done;
+        for (int i = 0; i < k; i++) {
+            bigmatrix[in] = values[done + i];
+            in = (in + 1) % BOUNDED_BUFFER_SIZE;
+        }
+        count += k;
+        done += k;
+
+        // One wakeup for the whole run; must happen before we wait for room again
+        buffer_wake(&not_empty, &not_empty_q, k > 1);
+    }
+    // Once per call, however many times it waited for room
+    STAT_WAIT_DONE(STAT_NOT_FULL);
+    STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
+    return done;
+}
+
+// Remove up to max matrices with one lock acquisition.  Blocks until at
+// least one is available; returns 0 once the buffer is closed and drained.
+int get_batch(Matrix ** values, int max)
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE) {
+        values[0] = ring_get(&ring);
+        if (values[0] == NULL)
+            return 0;
+        int k = 1;
+        while (k < max && (values[k] = ring_try_get(&ring)) != NULL)
+            k++;
+        return k;
+    }
+    if (BUFFER_ENGINE == ENGINE_SHAPE)
+        return shapebuf_get_batch(&shapebuf, values, max);
+    if (BUFFER_ENGINE == ENGINE_SPSC)
+        return spsc_get_batch(&spsc, worker_index, values, max);
+
+    STAT_LOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
+    while (count == 0) {
+        if (closed) {
+            STAT_WAIT_DONE(STAT_NOT_EMPTY);
+            STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
+            return 0;
+        }
+        buffer_wait(&not_empty, &not_empty_q, STAT_NOT_EMPTY);
+    }
+    STAT_WAIT_DONE(STAT_NOT_EMPTY);
+    STAT_OCCUPANCY(count);
+
+    int k = (count < max) ? count : max;
+    for (int i = 0; i < k; i++) {
+        values[i] = bigmatrix[out];
+        out = (out + 1) % BOUNDED_BUFFER_SIZE;
+    }
+    count -= k;
+
+    buffer_wake(&not_full, &not_full_q, k > 1);
+    STAT_UNLOCK(&buffer_mutex, STAT_BUFFER_MUTEX);
+    return k;
+}
+
+// Next matrix whose row count is 'rows', for use as M2 against an M1 with
+// cols == rows.  Only the shape-indexed engine can search; the others hand
+// back the next matrix in FIFO order for the caller to check.
+Matrix * get_compatible(int rows)
+{
+    if (BUFFER_ENGINE == ENGINE_SHAPE)
+        return shapebuf_get_compatible(&shapebuf, rows);
+    return get();
+}
+
+// Matrices currently buffered, sampled without locking (monitoring only)
+int buffer_occupancy()
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE)
+        return (int) ring_size(&ring);
+    if (BUFFER_ENGINE == ENGINE_SHAPE)
+        return shapebuf_size(&shapebuf);
+    if (BUFFER_ENGINE == ENGINE_SPSC)
+        return (int) spsc_size(&spsc);
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
+
+// Matrices claimed by producers (so about to be produced), consumed and
+// multiplied so far, sampled without locking (monitoring only)
+void buffer_progress(long *produced, long *consumed, long *multiplied)
+{
+    long claimed = atomic_load_explicit(&globalProduced.claimed, memory_order_relaxed);
+    // the quota overshoots once it runs out
+    if (!SERVICE && claimed > NUMBER_OF_MATRICES)
+        claimed = NUMBER_OF_MATRICES;
+    *produced = claimed;
+    *consumed = get_cnt(&globalConsumed);
+    *multiplied = get_cnt(&globalMultiplied);
+}
+
+// Batches consumers took from a queue other than their home queue
+// (ENGINE_SPSC); 0 for the other engines
+unsigned long buffer_steals()
+{
+    return (BUFFER_ENGINE == ENGINE_SPSC) ? spsc_stolen(&spsc) : 0;
+}
+
+// Called after the last put(): consumers drain what is left, then get() returns NULL
+void close_buffer()
+{
+    if (BUFFER_ENGINE == ENGINE_LOCKFREE) {
+        ring_close(&ring);
+        return;
+    }
+    if (BUFFER_ENGINE == ENGINE_SHAPE) {
+        shapebuf_close(&shapebuf);
+        return;
+    }
+    if (BUFFER_ENGINE == ENGINE_SPSC) {
+        spsc_close(&spsc);
+        return;
+    }
+
+    pthread_mutex_lock(&buffer_mutex);
+    closed = 1;
+    // Wake every waiting consumer, not just one
+    buffer_wake(&not_empty, &not_empty_q, 1);
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+// Matrix PRODUCER worker thread - arg is the producer's index
+// Report that this producer ran out of memory for what, and stop them all
+static void producer_fail(const char *what)
+{
+	fprintf(stderr, "Producer %d: out of memory for %s, production stops\n", worker_index, what);
+	atomic_store_explicit(&producer_failed, 1, memory_order_relaxed);
+}
+
+// Nonzero once a producer failed; the run's totals then fall short
+int producers_failed()
+{
+	return atomic_load_explicit(&producer_failed, memory_order_relaxed);
+}
+
 void *prod_worker(void *arg)
 {
+	// Each producer draws from its own random stream
+	worker_index = (int) (intptr_t) arg;
+	if (PLACEMENT)
+		placement_apply(SIDE_PRODUCERS, worker_index);
+	rng_thread_seed((uint64_t) worker_index);
+
 	// Allocate and initialize local statistics structure
-	ProdConsStats *stats = malloc(sizeof(ProdConsStats));
-	stats->sumtotal = 0;
-	stats->matrixtotal = 0;
-	stats->multtotal = 0;
+	ProdConsStats *stats = calloc(1, sizeof(ProdConsStats));
+
+	// Matrices generated locally and handed to put_batch() together
+	Matrix **batch = malloc(sizeof(Matrix *) * BATCH_SIZE);
+	if (stats == NULL || batch == NULL) {
+		producer_fail("its statistics and batch");
+		if (AUTOSCALE)
+			autoscale_release(SIDE_PRODUCERS);
+		free(batch);
+		return stats;
+	}
 
-	// Loop until global production counter reaches NUMBER_OF_MATRICES
+	// Loop until global production counter reaches NUMBER_OF_MATRICES, or
+	// in service mode until a stop signal arrives
+	long limit = SERVICE ? LONG_MAX : NUMBER_OF_MATRICES;
 	while (1) {
-		// Lock global counter to safely check production limit
-		pthread_mutex_lock(&global_counter_mutex);
-		if (globalProduced >= NUMBER_OF_MATRICES) {
-			pthread_mutex_unlock(&global_counter_mutex);
+		if (AUTOSCALE)
+			autoscale_park_point(SIDE_PRODUCERS, worker_index);
+
+		// Claim up to BATCH_SIZE of the remaining matrices in one atomic
+		long first;
+		int n = ((SERVICE && service_stopping()) || producers_failed()) ? 0 :
+			claim_quota(&globalProduced, limit, BATCH_SIZE, &first);
+		if (n == 0) {
+			// Parked producers would wait forever for work that is gone
+			if (AUTOSCALE)
+				autoscale_release(SIDE_PRODUCERS);
 			break;
 		}
-		// Increment globalProduced count
-		globalProduced++;
-		pthread_mutex_unlock(&global_counter_mutex);
-
-		// Generate a new matrix
-		Matrix *mat = GenMatrixRandom();
 
-		// Update local stats
-		stats->sumtotal += SumMatrix(mat);
-		stats->matrixtotal++;
+		for (int i = 0; i < n; i++) {
+			// Generate a new matrix, or take a view of record first+i of the input
+			Matrix *mat = INPUT_STREAM ? mstream_view(&input_stream, first + i) : GenMatrixRandom();
+			if (mat == NULL) {
+				// Hand over the ones made so far; the rest of the claim is dropped
+				producer_fail("an input record view");
+				n = i;
+				break;
+			}
+
+			// Generated matrices carry their sum; records from a file are summed once here
+			if (INPUT_STREAM)
+				mat->sum = SumMatrix(mat);
+
+			// Update local stats
+			stats->sumtotal += mat->sum;
+			stats->matrixtotal++;
+			if (TRACK_LATENCY)
+				mat->stamp = now_ns();
+			batch[i] = mat;
+		}
 
-		// Insert the new matrix into the bounded buffer
-		put(mat);
+		// Insert the new matrices into the bounded buffer
+		if (n > 0)
+			put_batch(batch, n);
 	}
 
+	free(batch);
+
 	// Return the statistics pointer so main() can aggregate results
 	return stats;
 }
 
-// Matrix CONSUMER worker thread
-void *cons_worker(void *arg)
+// Consumer-side staging area refilled by get_batch()
+typedef struct batch {
+    Matrix **items;
+    int n;
+    int next;
+} Batch;
+
+// Next matrix for this consumer, or NULL once the buffer is closed and drained
+static Matrix * next_matrix(Batch *b)
 {
-    // Allocate and initialize local statistics structure
-    ProdConsStats *stats = malloc(sizeof(ProdConsStats));
-    stats->sumtotal = 0;
-    stats->matrixtotal = 0;
-    stats->multtotal = 0;
+    if (b->next == b->n) {
+        b->n = get_batch(b->items, BATCH_SIZE);
+        b->next = 0;
+        if (b->n == 0)
+            return NULL;
+    }
+    return b->items[b->next++];
+}
 
-    while (1) {
-        // Check if all matrices have been consumed
-        pthread_mutex_lock(&global_counter_mutex);
-        if (globalConsumed >= NUMBER_OF_MATRICES) {
-            pthread_mutex_unlock(&global_counter_mutex);
-            break;
+// Show one product as
+//   MULTIPLY (r1 x c1) BY (r2 x c2):  m1  X  m2  =  result
+// or, for a longer chain in the given order,
+//   MULTIPLY (r1 x c1) BY (r2 x c2) BY (r3 x c3) AS ((A1 A2) A3):  m1  X  m2  X  m3  =  result
+// DISPLAY_SYNC prints it under stdout_mutex, DISPLAY_ASYNC formats the same
+// bytes into this thread's writer buffer, DISPLAY_BINARY writes records to
+// the result sink instead, DISPLAY_QUIET skips it
+static void display_product(Matrix **ms, int k, Matrix *result, const char *order)
+{
+    if (DISPLAY_MODE == DISPLAY_BINARY) {
+        sink_write_chain(ms, k, result);
+        return;
+    }
+    if (DISPLAY_MODE == DISPLAY_SYNC) {
+        STAT_LOCK(&stdout_mutex, STAT_STDOUT_MUTEX);
+        printf("\nMULTIPLY (%d x %d)", ms[0]->rows, ms[0]->cols);
+        for (int i = 1; i < k; i++)
+            printf(" BY (%d x %d)", ms[i]->rows, ms[i]->cols);
+        if (order != NULL)
+            printf(" AS %s", order);
+        printf(":\n");
+        DisplayMatrix(ms[0], stdout);
+        for (int i = 1; i < k; i++) {
+            printf("    X\n");
+            DisplayMatrix(ms[i], stdout);
         }
-        pthread_mutex_unlock(&global_counter_mutex);
+        printf("    =\n");
+        DisplayMatrix(result, stdout);
+        printf("\n");
+        STAT_UNLOCK(&stdout_mutex, STAT_STDOUT_MUTEX);
+        return;
+    }
+    if (DISPLAY_MODE != DISPLAY_ASYNC)
+        return;
+
+    // Reserve room for the whole block so it lands in one buffer
+    size_t max = 40 + FormatMatrixSize(result) + (order != NULL ? 4 + strlen(order) : 0);
+    for (int i = 0; i < k; i++)
+        max += 40 + FormatMatrixSize(ms[i]);
+    char *buf = writer_reserve(max);
+    if (buf == NULL)
+        return;
+    char *p = buf;
+    p += sprintf(p, "\nMULTIPLY (%d x %d)", ms[0]->rows, ms[0]->cols);
+    for (int i = 1; i < k; i++)
+        p += sprintf(p, " BY (%d x %d)", ms[i]->rows, ms[i]->cols);
+    if (order != NULL)
+        p += sprintf(p, " AS %s", order);
+    memcpy(p, ":\n", 2);
+    p += 2;
+    p += FormatMatrix(ms[0], p);
+    for (int i = 1; i < k; i++) {
+        memcpy(p, "    X\n", 6);
+        p += 6;
+        p += FormatMatrix(ms[i], p);
+    }
+    memcpy(p, "    =\n", 6);
+    p += 6;
+    p += FormatMatrix(result, p);
+    *p++ = '\n';
+    writer_commit(p - buf);
+}
+
+// Count a matrix just taken from the buffer into the consumer's stats
+static void consumed_one(ProdConsStats *stats, Matrix *mat)
+{
+    stats->matrixtotal++;
+    stats->sumtotal += mat->sum;
+    if (VERIFY_SUMS && SumMatrix(mat) != mat->sum)
+        stats->mismatches++;
+}
+
+// Record the latency of the k matrices whose product was just displayed
+static void product_done(ProdConsStats *stats, Matrix **ms, int k)
+{
+    if (stats->latency == NULL)
+        return;
+    uint64_t now = now_ns();
+    for (int i = 0; i < k; i++)
+        hist_record(stats->latency, now - ms[i]->stamp);
+}
+
+// Multiply pairs: M1 by the first compatible M2, discarding the others
+static void consume_pairs(ProdConsStats *stats, Batch *batch)
+{
+    // Runs until the buffer is closed and drained; matrices already staged
+    // in this consumer's batch are always consumed before exiting
+    while (1) {
+        // Park only with nothing staged, so no matrix is held while parked
+        if (AUTOSCALE && batch->next == batch->n)
+            autoscale_park_point(SIDE_CONSUMERS, worker_index);
 
         // Retrieve the first matrix (M1) from the bounded buffer
-        Matrix *m1 = get();
+        Matrix *m1 = next_matrix(batch);
         if (m1 == NULL) { // Stop if no more matrices
             break;
         }
 
-        stats->matrixtotal++;
-        stats->sumtotal += SumMatrix(m1);
+        consumed_one(stats, m1);
+        int consumed = 1;
 
         Matrix *m2 = NULL;
         Matrix *result = NULL;
 
-        // Try retrieving a valid second matrix (M2), avoid infinite loop
+        // Try retrieving a valid second matrix (M2), avoid infinite loop;
+        // a service run has no matrix count and stops when the buffer closes
         int attempts = 0;
-        while (attempts < NUMBER_OF_MATRICES) {
-            m2 = get();
+        while (SERVICE || attempts < NUMBER_OF_MATRICES) {
+            if (BUFFER_ENGINE == ENGINE_SHAPE)
+                m2 = get_compatible(m1->cols);
+            else
+                m2 = next_matrix(batch);
             if (m2 == NULL) {
                 break; // Stop if no more matrices
             }
 
-            stats->matrixtotal++;
-            stats->sumtotal += SumMatrix(m2);
+            consumed_one(stats, m2);
+            consumed++;
 
             if (m1->cols == m2->rows) {
-				// mutex lock before display
-				pthread_mutex_lock(&stdout_mutex);
-                // Format the display in the this format
-                printf("\nMULTIPLY (%d x %d) BY (%d x %d):\n", 
-                       m1->rows, m1->cols, m2->rows, m2->cols);
-                
-                // Display the matrices
-                DisplayMatrix(m1, stdout);
-                printf("    X\n");
-                DisplayMatrix(m2, stdout);
-                printf("    =\n");
-				
-                // Perform multiplication
+                // Perform multiplication (outside of any lock)
                 result = MatrixMultiply(m1, m2);
                 break;
             } else {
                 FreeMatrix(m2); // Free and retry
+                m2 = NULL;
             }
 
             attempts++;
         }
 
-        // If multiplication was successful, display the result
+        // If multiplication was successful, display the product
         if (result != NULL) {
-            DisplayMatrix(result, stdout);
-            printf("\n");
+            Matrix *pair[2] = { m1, m2 };
+            display_product(pair, 2, result, NULL);
+            product_done(stats, pair, 2);
             stats->multtotal++;
+            increment_cnt(&globalMultiplied);
             FreeMatrix(result);
         }
-		    // Unlock the mutex after all display operations
-			pthread_mutex_unlock(&stdout_mutex);
 
         FreeMatrix(m1);
         if (m2 != NULL) FreeMatrix(m2); // Avoid freeing NULL
 
-        // Update the global consumption counter (m1 and m2 have been consumed)
-        pthread_mutex_lock(&global_counter_mutex);
-        globalConsumed += 2;
-        pthread_mutex_unlock(&global_counter_mutex);
+        // Update the global consumption counter
+        add_cnt(&globalConsumed, consumed);
     }
+}
 
-    return stats;
+// Multiply chains of up to CHAIN_LENGTH compatible matrices in their
+// cheapest order.  A matrix that does not fit the chain ends it and starts
+// the next one, so nothing is discarded except a head no matrix fits.
+static void consume_chains(ProdConsStats *stats, Batch *batch)
+{
+    chain_t chain;
+    Matrix **ms = malloc(sizeof(Matrix *) * CHAIN_LENGTH);
+    char *order = malloc(6 * CHAIN_LENGTH + 1);
+    if (ms == NULL || order == NULL || chain_init(&chain, CHAIN_LENGTH) != 0) {
+        fprintf(stderr, "Failed to allocate chain workspace\n");
+        exit(1);
+    }
+
+    Matrix *carry = NULL; // matrix that ended the last chain
+    while (1) {
+        if (AUTOSCALE && carry == NULL && batch->next == batch->n)
+            autoscale_park_point(SIDE_CONSUMERS, worker_index);
+
+        // Head of the chain
+        Matrix *head = carry;
+        carry = NULL;
+        if (head == NULL) {
+            head = next_matrix(batch);
+            if (head == NULL)
+                break;
+            consumed_one(stats, head);
+            add_cnt(&globalConsumed, 1);
+        }
+        ms[0] = head;
+        int k = 1;
+
+        // Extend it until it is full, a matrix does not fit, or none are left
+        while (k < CHAIN_LENGTH) {
+            Matrix *next;
+            if (BUFFER_ENGINE == ENGINE_SHAPE)
+                next = get_compatible(ms[k - 1]->cols);
+            else
+                next = next_matrix(batch);
+            if (next == NULL)
+                break;
+            consumed_one(stats, next);
+            add_cnt(&globalConsumed, 1);
+            if (next->rows != ms[k - 1]->cols) {
+                carry = next;
+                break;
+            }
+            ms[k++] = next;
+        }
+
+        if (k >= 2) {
+            chain_plan(&chain, ms, k);
+            Matrix *result = chain_execute(&chain, ms);
+            // Like a failed pair product, a failed chain is not displayed
+            if (result != NULL) {
+                if (k > 2)
+                    chain_format_order(&chain, order);
+                display_product(ms, k, result, (k > 2) ? order : NULL);
+                product_done(stats, ms, k);
+                stats->multtotal++;
+                increment_cnt(&globalMultiplied);
+                stats->chained += k;
+                stats->chain_flops += chain.best;
+                stats->chain_flops_ltr += chain.left_to_right;
+                FreeMatrix(result);
+            }
+        }
+        for (int i = 0; i < k; i++)
+            FreeMatrix(ms[i]);
+    }
+
+    chain_free(&chain);
+    free(order);
+    free(ms);
 }
 
+// Matrix CONSUMER worker thread - arg is the consumer's index
+void *cons_worker(void *arg)
+{
+    worker_index = (int) (intptr_t) arg;
+    if (PLACEMENT)
+        placement_apply(SIDE_CONSUMERS, worker_index);
+
+    // Allocate and initialize local statistics structure
+    ProdConsStats *stats = calloc(1, sizeof(ProdConsStats));
+    stats->latency = TRACK_LATENCY ? hist_new() : NULL;
 
+    Batch batch = { malloc(sizeof(Matrix *) * BATCH_SIZE), 0, 0 };
 
+    if (CHAIN_LENGTH >= 2)
+        consume_chains(stats, &batch);
+    else
+        consume_pairs(stats, &batch);
+
+    // Hand any buffered output to the writer thread
+    if (DISPLAY_MODE == DISPLAY_ASYNC)
+        writer_flush_thread();
+    else if (DISPLAY_MODE == DISPLAY_BINARY)
+        sink_thread_done();
+
+    free(batch.items);
+    return stats;
+}
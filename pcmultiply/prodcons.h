@@ -14,16 +14,63 @@ Matrix ** bigmatrix;
 // sumtotal - total of all elements produced or consumed
 // multtotal - total number of matrices multipled
 // matrixtotal - total number of matrces produced or consumed
+// mismatches - consumers only, when VERIFY_SUMS: matrices whose elements
+//              no longer add up to their checksum
+// chained - consumers only, when CHAIN_LENGTH: matrices multiplied in chains
+// chain_flops - scalar multiplies spent on chains in their optimal order
+// chain_flops_ltr - what the same chains cost multiplied left to right
+// latency - consumers only, when TRACK_LATENCY: ns from generation to get()
 typedef struct prodcons {
-  int sumtotal;
-  int multtotal;
-  int matrixtotal;
+  long long sumtotal;
+  long long multtotal;
+  long long matrixtotal;
+  long long mismatches;
+  long long chained;
+  unsigned long long chain_flops;
+  unsigned long long chain_flops_ltr;
+  struct __hist_t * latency;
 } ProdConsStats;
 
 // PRODUCER-CONSUMER thread method function prototypes
 void *prod_worker(void *arg);
 void *cons_worker(void *arg);
 
+// Routines to map and unmap the binary matrix stream read by producers
+int open_input(const char *path);
+void close_input();
+
+// Routines to set up and tear down the bounded buffer for BUFFER_ENGINE
+int init_buffer();
+void free_buffer();
+
 // Routines to add and remove matrices from the bounded buffer
+// get() returns NULL once the buffer is closed and drained
 int put(Matrix *value);
 Matrix * get();
+void close_buffer();
+
+// Batched variants: move up to n / max matrix pointers per lock acquisition
+// put_batch() returns once all n are in the buffer
+// get_batch() returns the number removed, 0 once closed and drained
+int put_batch(Matrix **values, int n);
+int get_batch(Matrix **values, int max);
+
+// Matrices in the buffer right now, sampled without locking
+int buffer_occupancy();
+
+// Matrices produced, consumed and multiplied so far, sampled without locking
+void buffer_progress(long *produced, long *consumed, long *multiplied);
+
+// Kernel sleeps, waits ended by spinning and futex wake calls of the
+// condvar buffer (ENGINE_CONDVAR), for comparing WAIT_STRATEGY settings
+void buffer_wait_stats(unsigned long *sleeps, unsigned long *spin_hits, unsigned long *wake_calls);
+
+// Batches a consumer stole from another's queue (ENGINE_SPSC only)
+unsigned long buffer_steals();
+
+// Nonzero if a producer ran out of memory and production stopped early
+int producers_failed();
+
+// Next matrix with the given row count (shape-indexed engine); may return
+// another shape when the buffer is full, NULL once closed with no match
+Matrix * get_compatible(int rows);
@@ -0,0 +1,164 @@
+/*
+ *  Lock-free ring routines
+ *
+ *  Bounded MPMC queue with per-slot sequence numbers.  A slot whose
+ *  sequence equals the enqueue position is free for the producer that
+ *  claims that position; a slot whose sequence equals position+1 holds
+ *  an item for the consumer that claims that position.  The positions
+ *  only ever grow, so any capacity works (slot = position % capacity).
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include "matrix.h"
+#include "ring.h"
+
+// Number of pause-spins before a blocked thread yields the CPU
+#define RING_SPINS 64
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Spin briefly, then give the core away while the ring is full/empty
+static inline void backoff(int *spins)
+{
+  if (*spins < RING_SPINS)
+  {
+    cpu_relax();
+    (*spins)++;
+  }
+  else
+    sched_yield();
+}
+
+int ring_init(ring_t *r, size_t capacity)
+{
+  if (capacity == 0)
+    return -1;
+  r->slots = (ring_slot_t *) aligned_alloc(CACHE_LINE,
+      ((capacity * sizeof(ring_slot_t) + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE);
+  if (r->slots == NULL)
+    return -1;
+  for (size_t i = 0; i < capacity; i++)
+  {
+    atomic_init(&r->slots[i].seq, i);
+    r->slots[i].value = NULL;
+  }
+  r->capacity = capacity;
+  atomic_init(&r->enqueue_pos, 0);
+  atomic_init(&r->dequeue_pos, 0);
+  atomic_init(&r->closed, 0);
+  return 0;
+}
+
+void ring_destroy(ring_t *r)
+{
+  free(r->slots);
+  r->slots = NULL;
+}
+
+// Returns 0 on success, -1 if the ring is full
+int ring_try_put(ring_t *r, Matrix *value)
+{
+  size_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  for (;;)
+  {
+    ring_slot_t *slot = &r->slots[pos % r->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+    if (dif == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit(&r->enqueue_pos, &pos, pos + 1,
+            memory_order_relaxed, memory_order_relaxed))
+      {
+        slot->value = value;
+        atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+        return 0;
+      }
+      // CAS failure reloaded pos, try again
+    }
+    else if (dif < 0)
+      return -1;
+    else
+      pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  }
+}
+
+// Returns the oldest matrix, or NULL if the ring is empty
+Matrix * ring_try_get(ring_t *r)
+{
+  size_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+  for (;;)
+  {
+    ring_slot_t *slot = &r->slots[pos % r->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+    if (dif == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit(&r->dequeue_pos, &pos, pos + 1,
+            memory_order_relaxed, memory_order_relaxed))
+      {
+        Matrix *value = slot->value;
+        atomic_store_explicit(&slot->seq, pos + r->capacity, memory_order_release);
+        return value;
+      }
+    }
+    else if (dif < 0)
+      return NULL;
+    else
+      pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+  }
+}
+
+int ring_put(ring_t *r, Matrix *value)
+{
+  int spins = 0;
+  while (ring_try_put(r, value) != 0)
+    backoff(&spins);
+  return 0;
+}
+
+// Blocks until a matrix is available.  Returns NULL once the ring is
+// closed and fully drained.
+Matrix * ring_get(ring_t *r)
+{
+  int spins = 0;
+  for (;;)
+  {
+    Matrix *value = ring_try_get(r);
+    if (value != NULL)
+      return value;
+    if (atomic_load_explicit(&r->closed, memory_order_acquire))
+    {
+      // Every put() completed before close(), so one more look is final
+      return ring_try_get(r);
+    }
+    backoff(&spins);
+  }
+}
+
+// Approximate number of matrices in the ring, for monitoring
+size_t ring_size(ring_t *r)
+{
+  size_t out = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+  size_t in = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  return (in > out) ? in - out : 0;
+}
+
+// No more puts will follow.  Only sets the flag; nothing is woken.
+// Consumers see it when ring_get() polls between backoff rounds, then
+// drain what is left and get NULL.
+void ring_close(ring_t *r)
+{
+  atomic_store_explicit(&r->closed, 1, memory_order_release);
+}
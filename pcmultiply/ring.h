@@ -0,0 +1,43 @@
+/*
+ *  ring header
+ *  Function prototypes, data, and constants for the lock-free ring module
+ *
+ *  Bounded multi-producer/multi-consumer ring buffer of Matrix pointers.
+ *  Each slot carries a sequence number that tells producers and consumers
+ *  whose turn it is, so put/get are a single compare-and-swap on the
+ *  shared position plus a release store on the slot (D. Vyukov's design).
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+
+// LOCK-FREE RING
+
+// ring slot: sequence number + matrix pointer
+typedef struct __ring_slot_t {
+  atomic_size_t seq;
+  Matrix * value;
+} ring_slot_t;
+
+// ring structure - enqueue and dequeue positions live on separate cache lines
+typedef struct __ring_t {
+  ring_slot_t * slots;
+  size_t capacity;
+  _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+  _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+  _Alignas(CACHE_LINE) atomic_int closed;
+} ring_t;
+
+// ring methods
+int ring_init(ring_t *r, size_t capacity);
+void ring_destroy(ring_t *r);
+int ring_try_put(ring_t *r, Matrix *value);
+Matrix * ring_try_get(ring_t *r);
+int ring_put(ring_t *r, Matrix *value);
+Matrix * ring_get(ring_t *r);
+void ring_close(ring_t *r);
+size_t ring_size(ring_t *r);
@@ -0,0 +1,96 @@
+/*
+ *  Random number routines
+ *
+ *  xoshiro128** by D. Blackman and S. Vigna, seeded through splitmix64.
+ *  rng_range() maps to [0, n) with a multiply and shift (Lemire) instead
+ *  of a division; the tiny bias this leaves for n = 4 or 10 is far below
+ *  anything the matrix sums can show.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include "rng.h"
+
+// Master seed, set once before any worker thread starts
+static uint64_t master_seed = 0;
+
+// This thread's generator; threads that never call rng_thread_seed()
+// get stream numbers from a shared counter on first use
+static __thread rng_t thread_rng;
+static __thread int thread_seeded = 0;
+static uint64_t next_default_stream = 1ULL << 32;
+
+static uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+// Derive a state from (seed, stream); distinct streams give unrelated sequences
+void rng_seed(rng_t *r, uint64_t seed, uint64_t stream)
+{
+  uint64_t x = seed ^ splitmix64(&stream);
+  uint64_t a = splitmix64(&x);
+  uint64_t b = splitmix64(&x);
+  r->s[0] = (uint32_t) a;
+  r->s[1] = (uint32_t) (a >> 32);
+  r->s[2] = (uint32_t) b;
+  r->s[3] = (uint32_t) (b >> 32);
+  // xoshiro must not start from the all-zero state
+  if ((r->s[0] | r->s[1] | r->s[2] | r->s[3]) == 0)
+    r->s[0] = 1;
+}
+
+uint32_t rng_next(rng_t *r)
+{
+  uint32_t *s = r->s;
+  uint32_t result = rotl(s[1] * 5, 7) * 9;
+  uint32_t t = s[1] << 9;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 11);
+  return result;
+}
+
+// Uniform value in [0, n)
+uint32_t rng_range(rng_t *r, uint32_t n)
+{
+  return (uint32_t) (((uint64_t) rng_next(r) * n) >> 32);
+}
+
+// Set the master seed every thread generator derives from
+void rng_master_seed(uint64_t seed)
+{
+  master_seed = seed;
+}
+
+// Seed the calling thread's generator; stream is normally the thread's id
+void rng_thread_seed(uint64_t stream)
+{
+  rng_seed(&thread_rng, master_seed, stream);
+  thread_seeded = 1;
+}
+
+rng_t * rng_thread()
+{
+  if (!thread_seeded)
+  {
+    rng_seed(&thread_rng, master_seed,
+             __atomic_fetch_add(&next_default_stream, 1, __ATOMIC_RELAXED));
+    thread_seeded = 1;
+  }
+  return &thread_rng;
+}
@@ -0,0 +1,28 @@
+/*
+ *  rng header
+ *  Function prototypes, data, and constants for the random number module
+ *
+ *  xoshiro128** generator with one independent state per thread, so
+ *  producers never contend on a shared generator the way they do on
+ *  rand().  Each thread's state is derived from a master seed and the
+ *  thread's id, so a run is reproducible from its seed.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdint.h>
+
+// RANDOM NUMBER GENERATOR
+
+typedef struct __rng_t {
+  uint32_t s[4];
+} rng_t;
+
+// rng methods
+void rng_seed(rng_t *r, uint64_t seed, uint64_t stream);
+uint32_t rng_next(rng_t *r);
+uint32_t rng_range(rng_t *r, uint32_t n);
+void rng_master_seed(uint64_t seed);
+void rng_thread_seed(uint64_t stream);
+rng_t * rng_thread();
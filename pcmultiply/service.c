@@ -0,0 +1,186 @@
+/*
+ *  Service mode routines
+ *
+ *  The monitor thread sleeps on a condition variable with an absolute
+ *  CLOCK_MONOTONIC deadline per window, so the windows do not drift and
+ *  service_stop() can end the last one early.  Each window is reported
+ *  from counters the workers keep anyway; nothing is added to their
+ *  paths beyond one relaxed load of the stop flag per batch.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "matrix.h"
+#include "prodcons.h"
+#include "hist.h"
+#include "service.h"
+#include "pcmatrix.h"
+
+static atomic_int stop_signal;    // signal that asked to stop, 0 while running
+
+static pthread_mutex_t monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond;
+static int monitor_done;
+static pthread_t monitor;
+
+static FILE *out;                 // NULL for text on stderr
+static uint64_t start_ns;
+
+static void on_signal(int sig)
+{
+  atomic_store_explicit(&stop_signal, sig, memory_order_relaxed);
+}
+
+// Resident set size in bytes, 0 if /proc cannot tell
+static unsigned long long resident_bytes()
+{
+  unsigned long long size, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL)
+    return 0;
+  if (fscanf(f, "%llu %llu", &size, &resident) != 2)
+    resident = 0;
+  fclose(f);
+  return resident * (unsigned long long) sysconf(_SC_PAGESIZE);
+}
+
+// Report the window ending now, given the totals when it began
+static void report_window(uint64_t now, uint64_t window_ns, long last[3], int stopping)
+{
+  long cur[3];
+  buffer_progress(&cur[0], &cur[1], &cur[2]);
+  double secs = (double) window_ns / 1e9;
+  double rate[3];
+  for (int i = 0; i < 3; i++)
+  {
+    rate[i] = secs > 0 ? (cur[i] - last[i]) / secs : 0.0;
+    last[i] = cur[i];
+  }
+  double t = (double) (now - start_ns) / 1e9;
+  int occupied = buffer_occupancy();
+  double rss_mb = resident_bytes() / (1024.0 * 1024.0);
+
+  if (out != NULL)
+  {
+    fprintf(out, "{\"t_s\":%.3f,\"window_s\":%.3f,\"produced\":%ld,\"consumed\":%ld,\"multiplied\":%ld,"
+                 "\"produced_per_s\":%.1f,\"consumed_per_s\":%.1f,\"mults_per_s\":%.1f,"
+                 "\"buffer\":%d,\"buffer_size\":%d,\"rss_mb\":%.1f,\"draining\":%s}\n",
+            t, secs, cur[0], cur[1], cur[2], rate[0], rate[1], rate[2],
+            occupied, BOUNDED_BUFFER_SIZE, rss_mb, stopping ? "true" : "false");
+    fflush(out);
+  }
+  else
+    fprintf(stderr, "[%8.1fs] produced %10.1f/s consumed %10.1f/s multiplied %10.1f/s"
+                    " buffer %d/%d rss %.1f MB%s\n",
+            t, rate[0], rate[1], rate[2], occupied, BOUNDED_BUFFER_SIZE, rss_mb,
+            stopping ? " (draining)" : "");
+}
+
+static void *monitor_main(void *arg)
+{
+  long last[3] = { 0, 0, 0 };
+  int announced = 0;
+  uint64_t window_start = start_ns;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&monitor_mutex);
+  while (!monitor_done)
+  {
+    deadline.tv_nsec += (long) SERVICE_WINDOW_MS * 1000000L;
+    while (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while (!monitor_done &&
+           pthread_cond_timedwait(&monitor_cond, &monitor_mutex, &deadline) == 0)
+      ;
+    pthread_mutex_unlock(&monitor_mutex);
+
+    int sig = atomic_load_explicit(&stop_signal, memory_order_relaxed);
+    if (sig != 0 && !announced)
+    {
+      fprintf(stderr, "Service: %s received, draining the buffer\n", strsignal(sig));
+      announced = 1;
+    }
+    uint64_t now = now_ns();
+    report_window(now, now - window_start, last, sig != 0);
+    window_start = now;
+
+    pthread_mutex_lock(&monitor_mutex);
+  }
+  pthread_mutex_unlock(&monitor_mutex);
+  return NULL;
+}
+
+// Catch SIGINT/SIGTERM and start reporting windows, to stats_path if not
+// NULL; returns -1 if the file or the monitor thread cannot be set up
+int service_start(const char *stats_path)
+{
+  out = NULL;
+  if (stats_path != NULL)
+  {
+    out = fopen(stats_path, "w");
+    if (out == NULL)
+    {
+      perror(stats_path);
+      return -1;
+    }
+  }
+
+  atomic_init(&stop_signal, 0);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sa.sa_flags = SA_RESETHAND;   // a second signal is not caught
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&monitor_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  monitor_done = 0;
+  start_ns = now_ns();
+  if (pthread_create(&monitor, NULL, monitor_main, NULL) != 0)
+  {
+    if (out != NULL)
+      fclose(out);
+    return -1;
+  }
+  return 0;
+}
+
+// Nonzero once a stop signal arrived; producers check it between batches
+int service_stopping()
+{
+  return atomic_load_explicit(&stop_signal, memory_order_relaxed) != 0;
+}
+
+// Report the final partial window and stop the monitor; call once the
+// consumers have drained the buffer
+void service_stop()
+{
+  pthread_mutex_lock(&monitor_mutex);
+  monitor_done = 1;
+  pthread_cond_signal(&monitor_cond);
+  pthread_mutex_unlock(&monitor_mutex);
+  pthread_join(monitor, NULL);
+  pthread_cond_destroy(&monitor_cond);
+  if (out != NULL)
+    fclose(out);
+}
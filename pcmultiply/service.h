@@ -0,0 +1,29 @@
+/*
+ *  service header
+ *  Function prototypes, data, and constants for the service mode module
+ *
+ *  With --service the producers ignore the matrix count and keep going
+ *  until SIGINT or SIGTERM.  The signal handler only sets a flag; the
+ *  producers see it before claiming their next batch and exit, and the
+ *  run then ends as usual: the buffer is closed, the consumers drain
+ *  every matrix already produced, and the totals still balance.  A
+ *  second signal ends the process at once.
+ *
+ *  Meanwhile a monitor thread reports each SERVICE_WINDOW_MS window:
+ *  produced, consumed and multiplied rates, buffer occupancy and the
+ *  resident set size.  Reports go to stderr as text, or with
+ *  --service-stats=FILE to FILE as one JSON object per line.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Length of one reporting window
+#define SERVICE_WINDOW_MS 1000
+
+// SERVICE MODE
+
+// service methods
+int service_start(const char *stats_path);
+int service_stopping();
+void service_stop();
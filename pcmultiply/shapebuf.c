@@ -0,0 +1,233 @@
+/*
+ *  Shape-indexed buffer routines
+ *
+ *  A consumer waiting for a particular row count could starve forever if
+ *  the buffer fills with other shapes: producers block on not_full and
+ *  nothing new arrives.  So when the buffer is full, get_compatible()
+ *  hands back the oldest entry of any shape instead, which the consumer
+ *  discards exactly as it always has.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "shapebuf.h"
+
+#define QUEUE_OF(rows) ((unsigned) (rows) & (SHAPE_QUEUES - 1))
+
+int shapebuf_init(shapebuf_t *sb, int capacity)
+{
+  if (capacity <= 0)
+    return -1;
+  sb->nodes = (shape_node_t *) malloc(sizeof(shape_node_t) * capacity);
+  if (sb->nodes == NULL)
+    return -1;
+  for (int i = 0; i < capacity; i++)
+    sb->nodes[i].next = (i + 1 < capacity) ? &sb->nodes[i + 1] : NULL;
+  sb->free_nodes = &sb->nodes[0];
+
+  pthread_mutex_init(&sb->lock, NULL);
+  pthread_cond_init(&sb->not_full, NULL);
+  pthread_cond_init(&sb->not_empty, NULL);
+  for (int q = 0; q < SHAPE_QUEUES; q++)
+  {
+    sb->queues[q].head = NULL;
+    sb->queues[q].tail = NULL;
+    pthread_cond_init(&sb->queues[q].ready, NULL);
+  }
+  sb->nonempty = 0;
+  sb->capacity = capacity;
+  sb->count = 0;
+  sb->closed = 0;
+  sb->seq = 0;
+  return 0;
+}
+
+void shapebuf_destroy(shapebuf_t *sb)
+{
+  for (int q = 0; q < SHAPE_QUEUES; q++)
+    pthread_cond_destroy(&sb->queues[q].ready);
+  pthread_cond_destroy(&sb->not_full);
+  pthread_cond_destroy(&sb->not_empty);
+  pthread_mutex_destroy(&sb->lock);
+  free(sb->nodes);
+  sb->nodes = NULL;
+}
+
+// Append to the tail of its partition (lock held, a node is free)
+static void enqueue(shapebuf_t *sb, Matrix *value)
+{
+  shape_node_t *node = sb->free_nodes;
+  sb->free_nodes = node->next;
+  node->value = value;
+  node->seq = sb->seq++;
+  node->next = NULL;
+
+  unsigned q = QUEUE_OF(value->rows);
+  shape_queue_t *sq = &sb->queues[q];
+  if (sq->tail == NULL)
+    sq->head = node;
+  else
+    sq->tail->next = node;
+  sq->tail = node;
+  sb->nonempty |= 1UL << q;
+  sb->count++;
+}
+
+// Unlink node (whose predecessor is prev, NULL for the head) from queue q
+static Matrix * dequeue(shapebuf_t *sb, unsigned q, shape_node_t *prev, shape_node_t *node)
+{
+  shape_queue_t *sq = &sb->queues[q];
+  if (prev == NULL)
+    sq->head = node->next;
+  else
+    prev->next = node->next;
+  if (sq->tail == node)
+    sq->tail = prev;
+  if (sq->head == NULL)
+    sb->nonempty &= ~(1UL << q);
+
+  Matrix *value = node->value;
+  node->next = sb->free_nodes;
+  sb->free_nodes = node;
+  sb->count--;
+  return value;
+}
+
+// Oldest entry of any shape (lock held, count > 0)
+static Matrix * dequeue_oldest(shapebuf_t *sb)
+{
+  unsigned best = 0;
+  unsigned long best_seq = 0;
+  int found = 0;
+  for (unsigned long bits = sb->nonempty; bits != 0; bits &= bits - 1)
+  {
+    unsigned q = __builtin_ctzl(bits);
+    if (!found || sb->queues[q].head->seq < best_seq)
+    {
+      best = q;
+      best_seq = sb->queues[q].head->seq;
+      found = 1;
+    }
+  }
+  return dequeue(sb, best, NULL, sb->queues[best].head);
+}
+
+// Wake consumers waiting on specific shapes so they re-check their predicate
+static void wake_all_shapes(shapebuf_t *sb)
+{
+  for (int q = 0; q < SHAPE_QUEUES; q++)
+    pthread_cond_broadcast(&sb->queues[q].ready);
+}
+
+int shapebuf_put_batch(shapebuf_t *sb, Matrix **values, int n)
+{
+  int done = 0;
+  pthread_mutex_lock(&sb->lock);
+  while (done < n)
+  {
+    while (sb->count == sb->capacity)
+    {
+      // Full: shape waiters must stop holding out for a match
+      wake_all_shapes(sb);
+      pthread_cond_wait(&sb->not_full, &sb->lock);
+    }
+
+    unsigned long touched = 0;
+    while (done < n && sb->count < sb->capacity)
+    {
+      touched |= 1UL << QUEUE_OF(values[done]->rows);
+      enqueue(sb, values[done++]);
+    }
+
+    for (; touched != 0; touched &= touched - 1)
+      pthread_cond_broadcast(&sb->queues[__builtin_ctzl(touched)].ready);
+    pthread_cond_broadcast(&sb->not_empty);
+  }
+  pthread_mutex_unlock(&sb->lock);
+  return done;
+}
+
+int shapebuf_get_batch(shapebuf_t *sb, Matrix **values, int max)
+{
+  pthread_mutex_lock(&sb->lock);
+  while (sb->count == 0)
+  {
+    if (sb->closed)
+    {
+      pthread_mutex_unlock(&sb->lock);
+      return 0;
+    }
+    pthread_cond_wait(&sb->not_empty, &sb->lock);
+  }
+
+  int k = 0;
+  while (k < max && sb->count > 0)
+    values[k++] = dequeue_oldest(sb);
+
+  if (k == 1)
+    pthread_cond_signal(&sb->not_full);
+  else
+    pthread_cond_broadcast(&sb->not_full);
+  pthread_mutex_unlock(&sb->lock);
+  return k;
+}
+
+// Oldest matrix with the given row count.  When the buffer is full and has
+// none, the oldest matrix of any shape.  NULL once closed with no match.
+Matrix * shapebuf_get_compatible(shapebuf_t *sb, int rows)
+{
+  unsigned q = QUEUE_OF(rows);
+  shape_queue_t *sq = &sb->queues[q];
+  Matrix *value = NULL;
+
+  pthread_mutex_lock(&sb->lock);
+  for (;;)
+  {
+    shape_node_t *prev = NULL;
+    for (shape_node_t *node = sq->head; node != NULL; prev = node, node = node->next)
+    {
+      if (node->value->rows == rows)
+      {
+        value = dequeue(sb, q, prev, node);
+        break;
+      }
+    }
+    if (value != NULL)
+      break;
+
+    if (sb->count == sb->capacity)
+    {
+      value = dequeue_oldest(sb);
+      break;
+    }
+    if (sb->closed)
+      break;
+
+    pthread_cond_wait(&sq->ready, &sb->lock);
+  }
+  if (value != NULL)
+    pthread_cond_signal(&sb->not_full);
+  pthread_mutex_unlock(&sb->lock);
+  return value;
+}
+
+void shapebuf_close(shapebuf_t *sb)
+{
+  pthread_mutex_lock(&sb->lock);
+  sb->closed = 1;
+  pthread_cond_broadcast(&sb->not_empty);
+  wake_all_shapes(sb);
+  pthread_mutex_unlock(&sb->lock);
+}
+
+// Number of matrices buffered; read without the lock, for monitoring
+int shapebuf_size(shapebuf_t *sb)
+{
+  return __atomic_load_n(&sb->count, __ATOMIC_RELAXED);
+}
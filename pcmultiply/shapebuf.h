@@ -0,0 +1,55 @@
+/*
+ *  shapebuf header
+ *  Function prototypes, data, and constants for the shape-indexed buffer
+ *
+ *  Bounded buffer partitioned by matrix row count so a consumer holding
+ *  M1 can ask directly for an M2 with rows == M1->cols.  One lock and one
+ *  global capacity bound cover all partitions; within a row count,
+ *  matrices leave in the order they arrived.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Row-count partitions (power of two, at most 64 for the bitmask below).
+// Row counts that collide share a partition and are told apart by a scan.
+#define SHAPE_QUEUES 64
+
+// SHAPE-INDEXED BUFFER
+
+// buffer entry: seq orders entries across partitions for get()
+typedef struct __shape_node_t {
+  Matrix * value;
+  unsigned long seq;
+  struct __shape_node_t * next;
+} shape_node_t;
+
+// one partition: FIFO list plus the condition its consumers wait on
+typedef struct __shape_queue_t {
+  shape_node_t * head;
+  shape_node_t * tail;
+  pthread_cond_t ready;
+} shape_queue_t;
+
+typedef struct __shapebuf_t {
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+  shape_queue_t queues[SHAPE_QUEUES];
+  unsigned long nonempty;      // bit q set when queues[q] has entries
+  shape_node_t * nodes;        // capacity entries, preallocated
+  shape_node_t * free_nodes;
+  int capacity;
+  int count;
+  int closed;
+  unsigned long seq;
+} shapebuf_t;
+
+// shapebuf methods
+int shapebuf_init(shapebuf_t *sb, int capacity);
+void shapebuf_destroy(shapebuf_t *sb);
+int shapebuf_put_batch(shapebuf_t *sb, Matrix **values, int n);
+int shapebuf_get_batch(shapebuf_t *sb, Matrix **values, int max);
+Matrix * shapebuf_get_compatible(shapebuf_t *sb, int rows);
+void shapebuf_close(shapebuf_t *sb);
+int shapebuf_size(shapebuf_t *sb);
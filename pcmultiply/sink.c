@@ -0,0 +1,243 @@
+/*
+ *  Binary result sink routines
+ *
+ *  SINK_MMAP maps SINK_RESERVE bytes of the file up front, although the
+ *  file itself starts at the expected output size.  The mapping never
+ *  moves, so the file can grow (ftruncate under grow_mutex, doubling)
+ *  while other consumers keep writing below the old end.  A writer only
+ *  touches its reservation after making sure the file covers it.
+ *
+ *  The header and index are written by sink_close() once every consumer
+ *  is done; the index is built by walking the records, which lie back
+ *  to back from the data offset.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "matrix.h"
+#include "mstream.h"
+#include "sink.h"
+
+static int sink_fd = -1;
+static int sink_records = SINK_TRIPLES;
+static int sink_io = SINK_MMAP;
+static char * sink_base = NULL;                 // SINK_MMAP only
+static atomic_ullong sink_offset;              // next free byte
+static atomic_ullong sink_size;                // current file size
+static atomic_ullong sink_count;               // records written
+static atomic_int sink_error;
+static pthread_mutex_t grow_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Per-thread encode buffer for SINK_PWRITE
+static __thread char * scratch = NULL;
+static __thread size_t scratch_cap = 0;
+
+// Make the file at least end bytes long
+static int ensure_size(unsigned long long end)
+{
+  if (end <= atomic_load_explicit(&sink_size, memory_order_acquire))
+    return 0;
+  int rc = 0;
+  pthread_mutex_lock(&grow_mutex);
+  unsigned long long size = atomic_load_explicit(&sink_size, memory_order_relaxed);
+  if (end > size)
+  {
+    unsigned long long grown = 2 * size;
+    if (grown < end)
+      grown = end;
+    if (sink_io == SINK_MMAP && grown > SINK_RESERVE)
+      grown = end;
+    if ((sink_io == SINK_MMAP && grown > SINK_RESERVE) || ftruncate(sink_fd, (off_t) grown) != 0)
+      rc = -1;
+    else
+      atomic_store_explicit(&sink_size, grown, memory_order_release);
+  }
+  pthread_mutex_unlock(&grow_mutex);
+  return rc;
+}
+
+static int pwrite_all(const char *p, size_t len, off_t off)
+{
+  while (len > 0)
+  {
+    ssize_t n = pwrite(sink_fd, p, len, off);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    len -= (size_t) n;
+    off += n;
+  }
+  return 0;
+}
+
+// Create path for records (SINK_TRIPLES/SINK_PRODUCTS) written through io
+// (SINK_MMAP/SINK_PWRITE).  expected is the output size to start the file
+// at; it grows as needed.  Falls back to SINK_PWRITE if mapping fails.
+int sink_open(const char *path, int records, int io, size_t expected)
+{
+  sink_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (sink_fd < 0)
+  {
+    perror(path);
+    return -1;
+  }
+  sink_records = records;
+  sink_io = io;
+  atomic_init(&sink_offset, sizeof(mstream_header_t));
+  atomic_init(&sink_size, 0);
+  atomic_init(&sink_count, 0);
+  atomic_init(&sink_error, 0);
+  if (ensure_size(sizeof(mstream_header_t) + expected) != 0)
+  {
+    perror(path);
+    close(sink_fd);
+    return -1;
+  }
+
+  if (sink_io == SINK_MMAP)
+  {
+    void *p = mmap(NULL, SINK_RESERVE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+                   sink_fd, 0);
+    if (p == MAP_FAILED)
+    {
+      fprintf(stderr, "%s: cannot map output, using pwrite\n", path);
+      sink_io = SINK_PWRITE;
+    }
+    else
+      sink_base = (char *) p;
+  }
+  return 0;
+}
+
+// Called by a consumer for every product of ms[0..k-1], each operand
+// written too when SINK_TRIPLES; safe from any number of threads
+int sink_write_chain(Matrix **ms, int k, Matrix *result)
+{
+  size_t size = MSTREAM_RECORD_SIZE(result->rows, result->cols);
+  if (sink_records == SINK_TRIPLES)
+    for (int i = 0; i < k; i++)
+      size += MSTREAM_RECORD_SIZE(ms[i]->rows, ms[i]->cols);
+
+  unsigned long long off = atomic_fetch_add_explicit(&sink_offset, size, memory_order_relaxed);
+  if (ensure_size(off + size) != 0)
+  {
+    atomic_store_explicit(&sink_error, 1, memory_order_relaxed);
+    return -1;
+  }
+
+  char *dst;
+  if (sink_io == SINK_MMAP)
+    dst = sink_base + off;
+  else
+  {
+    if (scratch_cap < size)
+    {
+      free(scratch);
+      scratch_cap = (size > 65536) ? size : 65536;
+      scratch = (char *) malloc(scratch_cap);
+      if (scratch == NULL)
+      {
+        scratch_cap = 0;
+        atomic_store_explicit(&sink_error, 1, memory_order_relaxed);
+        return -1;
+      }
+    }
+    dst = scratch;
+  }
+
+  char *p = dst;
+  if (sink_records == SINK_TRIPLES)
+    for (int i = 0; i < k; i++)
+      p += mstream_encode(p, ms[i], (i == 0) ? MSTREAM_TAG_LEFT : MSTREAM_TAG_RIGHT);
+  p += mstream_encode(p, result, MSTREAM_TAG_PRODUCT);
+  atomic_fetch_add_explicit(&sink_count, (sink_records == SINK_TRIPLES) ? k + 1 : 1,
+                            memory_order_relaxed);
+
+  if (sink_io == SINK_PWRITE && pwrite_all(dst, size, (off_t) off) != 0)
+  {
+    atomic_store_explicit(&sink_error, 1, memory_order_relaxed);
+    return -1;
+  }
+  return 0;
+}
+
+// Release the calling thread's encode buffer; call before it exits
+void sink_thread_done()
+{
+  free(scratch);
+  scratch = NULL;
+  scratch_cap = 0;
+}
+
+// Call once every consumer has finished.  Trims the file, appends the
+// index, writes the header and closes it; records and bytes describe
+// what was written.  Returns -1 if any write failed.
+int sink_close(unsigned long long *records, unsigned long long *bytes)
+{
+  unsigned long long end = atomic_load(&sink_offset);
+  unsigned long long count = atomic_load(&sink_count);
+  int rc = atomic_load(&sink_error) ? -1 : 0;
+
+  // Walk the records to build the index
+  uint64_t *index = (uint64_t *) malloc(sizeof(uint64_t) * (count ? count : 1));
+  const char *base = sink_base;
+  if (base == NULL && end > sizeof(mstream_header_t))
+  {
+    void *p = mmap(NULL, end, PROT_READ, MAP_SHARED, sink_fd, 0);
+    base = (p == MAP_FAILED) ? NULL : (const char *) p;
+  }
+  if (index == NULL || (base == NULL && count > 0))
+    rc = -1;
+  else
+  {
+    unsigned long long off = sizeof(mstream_header_t);
+    for (unsigned long long i = 0; i < count && off < end; i++)
+    {
+      const mstream_record_t *r = (const mstream_record_t *) (base + off);
+      index[i] = off;
+      off += MSTREAM_RECORD_SIZE(r->rows, r->cols);
+    }
+  }
+  if (sink_base != NULL)
+    munmap(sink_base, SINK_RESERVE);
+  else if (base != NULL)
+    munmap((void *) base, end);
+  sink_base = NULL;
+
+  mstream_header_t h;
+  mstream_init_header(&h);
+  h.count = count;
+  h.index_offset = end;
+  if (rc == 0)
+  {
+    if (ftruncate(sink_fd, (off_t) end) != 0 ||
+        pwrite_all((const char *) index, sizeof(uint64_t) * count, (off_t) end) != 0 ||
+        pwrite_all((const char *) &h, sizeof(h), 0) != 0)
+      rc = -1;
+  }
+  free(index);
+  if (close(sink_fd) != 0)
+    rc = -1;
+  sink_fd = -1;
+
+  if (records != NULL)
+    *records = count;
+  if (bytes != NULL)
+    *bytes = end + sizeof(uint64_t) * count;
+  return rc;
+}
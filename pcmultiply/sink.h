@@ -0,0 +1,33 @@
+/*
+ *  sink header
+ *  Function prototypes, data, and constants for the binary result sink module
+ *
+ *  Consumers write their products to one file in the matrix stream
+ *  format (mstream.h), so the output can be read back with --input or
+ *  any other stream reader.  A consumer reserves room for its records
+ *  with one atomic add on the file offset and fills it with memcpy, so
+ *  consumers never wait for each other.  Records from different
+ *  consumers interleave, but a product's records are always adjacent
+ *  and in order: left operand, right operand(s), product.  A pair gives
+ *  a triple; a --chain product has one right record per further matrix.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// What is written per multiplication
+#define SINK_TRIPLES 0      // operand records, then the product
+#define SINK_PRODUCTS 1     // product record only
+
+// How the records reach the file
+#define SINK_MMAP 0         // memcpy into a shared mapping of the file
+#define SINK_PWRITE 1       // encode into a thread buffer, then pwrite()
+
+// Address space reserved for the mapping; the file grows inside it
+#define SINK_RESERVE (1ULL << 40)
+
+// sink methods
+int sink_open(const char *path, int records, int io, size_t expected);
+int sink_write_chain(Matrix **ms, int k, Matrix *result);
+void sink_thread_done();
+int sink_close(unsigned long long *records, unsigned long long *bytes);
@@ -0,0 +1,352 @@
+/*
+ *  Sparse (CSR) matrix routines
+ *
+ *  Generation and sparse x sparse products first build their rows in a
+ *  per-thread scratch CSR, since the nonzero count is only known at the
+ *  end; finish() then copies the result into a matrix of the right form
+ *  and exact size.  The scratch is kept between calls and freed by the
+ *  key destructor at thread exit.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "kernels.h"
+#include "rng.h"
+#include "sparse.h"
+#include "pcmatrix.h"
+
+// Per-thread scratch CSR plus the sparse x sparse row accumulator
+typedef struct __sparse_scratch_t {
+  int * values;
+  int * colidx;
+  int nnz_cap;
+  int * rowptr;
+  int rows_cap;
+  unsigned * acc;        // row being accumulated, valid where mark == stamp
+  unsigned * mark;
+  int * touched;         // columns set in acc for this row
+  int cols_cap;
+  unsigned stamp;
+} sparse_scratch_t;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static atomic_ulong generated;
+static atomic_ulong generated_csr;
+static atomic_ulong products;
+static atomic_ulong products_csr;
+
+static void free_scratch(void *p)
+{
+  sparse_scratch_t *s = (sparse_scratch_t *) p;
+  free(s->values);
+  free(s->colidx);
+  free(s->rowptr);
+  free(s->acc);
+  free(s->mark);
+  free(s->touched);
+  free(s);
+}
+
+static void make_scratch_key()
+{
+  pthread_key_create(&scratch_key, free_scratch);
+}
+
+static sparse_scratch_t * thread_scratch()
+{
+  pthread_once(&scratch_once, make_scratch_key);
+  sparse_scratch_t *s = (sparse_scratch_t *) pthread_getspecific(scratch_key);
+  if (s == NULL)
+  {
+    s = (sparse_scratch_t *) calloc(1, sizeof(sparse_scratch_t));
+    if (s == NULL)
+    {
+      fprintf(stderr, "Out of memory for sparse scratch\n");
+      exit(1);
+    }
+    pthread_setspecific(scratch_key, s);
+  }
+  return s;
+}
+
+static void * grow(void *p, size_t bytes)
+{
+  p = realloc(p, bytes);
+  if (p == NULL)
+  {
+    fprintf(stderr, "Out of memory for sparse scratch\n");
+    exit(1);
+  }
+  return p;
+}
+
+// Room for nnz elements in the scratch CSR
+static void ensure_nnz(sparse_scratch_t *s, int nnz)
+{
+  if (nnz <= s->nnz_cap)
+    return;
+  int cap = s->nnz_cap ? s->nnz_cap : 256;
+  while (cap < nnz)
+    cap *= 2;
+  s->values = (int *) grow(s->values, sizeof(int) * cap);
+  s->colidx = (int *) grow(s->colidx, sizeof(int) * cap);
+  s->nnz_cap = cap;
+}
+
+static void ensure_rows(sparse_scratch_t *s, int rows)
+{
+  if (rows + 1 <= s->rows_cap)
+    return;
+  s->rowptr = (int *) grow(s->rowptr, sizeof(int) * (rows + 1));
+  s->rows_cap = rows + 1;
+}
+
+static void ensure_cols(sparse_scratch_t *s, int cols)
+{
+  if (cols <= s->cols_cap)
+    return;
+  s->acc = (unsigned *) grow(s->acc, sizeof(unsigned) * cols);
+  s->mark = (unsigned *) grow(s->mark, sizeof(unsigned) * cols);
+  s->touched = (int *) grow(s->touched, sizeof(int) * cols);
+  // fresh marks must not match any stamp handed out so far
+  memset(s->mark, 0, sizeof(unsigned) * cols);
+  s->stamp = 0;
+  s->cols_cap = cols;
+}
+
+// Store with CSR once nnz is at most SPARSE_RATIO of the elements
+static int want_csr(int rows, int cols, int nnz)
+{
+  return SPARSE_RATIO > 0 && (double) nnz <= SPARSE_RATIO * (double) rows * (double) cols;
+}
+
+// Copy the scratch CSR (rows x cols, nnz elements) into a new matrix,
+// CSR or dense as want_csr() says
+static Matrix * finish(sparse_scratch_t *s, int rows, int cols, int nnz)
+{
+  Matrix *mat;
+  if (want_csr(rows, cols, nnz))
+  {
+    mat = NewSparseMatrix(rows, cols, nnz);
+    memcpy(CSR_VALUES(mat), s->values, sizeof(int) * nnz);
+    memcpy(CSR_ROWPTR(mat), s->rowptr, sizeof(int) * (rows + 1));
+    memcpy(CSR_COLIDX(mat), s->colidx, sizeof(int) * nnz);
+    return mat;
+  }
+  mat = AllocMatrix(rows, cols);
+  for (int i = 0; i < rows; i++)
+  {
+    int *mm = MATRIX_ROW(mat, i);
+    memset(mm, 0, sizeof(int) * cols);
+    for (int p = s->rowptr[i]; p < s->rowptr[i + 1]; p++)
+      mm[s->colidx[p]] = s->values[p];
+  }
+  return mat;
+}
+
+// Generate a rows x cols matrix whose elements are nonzero with
+// probability DENSITY, stored in whichever form its nnz picks
+Matrix * sparse_gen(int rows, int cols)
+{
+  sparse_scratch_t *s = thread_scratch();
+  rng_t *rng = rng_thread();
+  uint64_t cutoff = (uint64_t) (DENSITY * 4294967296.0);
+  long long sum = 0;
+  int nnz = 0;
+  ensure_rows(s, rows);
+  for (int i = 0; i < rows; i++)
+  {
+    s->rowptr[i] = nnz;
+    ensure_nnz(s, nnz + cols);
+    for (int j = 0; j < cols; j++)
+    {
+      if (rng_next(rng) >= cutoff)
+        continue;
+      int v = (MATRIX_MODE == 0) ? 1 + rng_range(rng, 10) : 1;
+      s->values[nnz] = v;
+      s->colidx[nnz] = j;
+      nnz++;
+      sum += v;
+    }
+  }
+  s->rowptr[rows] = nnz;
+
+  Matrix *mat = finish(s, rows, cols, nnz);
+  mat->sum = sum;
+  atomic_fetch_add_explicit(&generated, 1, memory_order_relaxed);
+  if (MATRIX_IS_SPARSE(mat))
+    atomic_fetch_add_explicit(&generated_csr, 1, memory_order_relaxed);
+  return mat;
+}
+
+// c (dense) = a (CSR) x b (dense): row k of b is added into row i of c
+// once per stored a[i][k]
+static void csr_dense(Matrix *a, Matrix *b, Matrix *c)
+{
+  const unsigned *av = (const unsigned *) CSR_VALUES(a);
+  const int *arow = CSR_ROWPTR(a);
+  const int *acol = CSR_COLIDX(a);
+  int n = c->cols;
+  for (int i = 0; i < a->rows; i++)
+  {
+    unsigned *cc = (unsigned *) MATRIX_ROW(c, i);
+    memset(cc, 0, sizeof(unsigned) * n);
+    for (int p = arow[i]; p < arow[i + 1]; p++)
+    {
+      unsigned x = av[p];
+      const unsigned *bb = (const unsigned *) MATRIX_ROW(b, acol[p]);
+      for (int j = 0; j < n; j++)
+        cc[j] += x * bb[j];
+    }
+  }
+}
+
+// c (dense) = a (dense) x b (CSR): every nonzero a[i][k] scatters row k
+// of b into row i of c
+static void dense_csr(Matrix *a, Matrix *b, Matrix *c)
+{
+  const unsigned *bv = (const unsigned *) CSR_VALUES(b);
+  const int *brow = CSR_ROWPTR(b);
+  const int *bcol = CSR_COLIDX(b);
+  for (int i = 0; i < a->rows; i++)
+  {
+    const unsigned *aa = (const unsigned *) MATRIX_ROW(a, i);
+    unsigned *cc = (unsigned *) MATRIX_ROW(c, i);
+    memset(cc, 0, sizeof(unsigned) * c->cols);
+    for (int k = 0; k < a->cols; k++)
+    {
+      unsigned x = aa[k];
+      if (x == 0)
+        continue;
+      for (int p = brow[k]; p < brow[k + 1]; p++)
+        cc[bcol[p]] += x * bv[p];
+    }
+  }
+}
+
+static int compare_int(const void *x, const void *y)
+{
+  int a = *(const int *) x;
+  int b = *(const int *) y;
+  return (a > b) - (a < b);
+}
+
+// a (CSR) x b (CSR), Gustavson's row-by-row method: row i of the product
+// is the sum of the rows k of b picked by row i of a
+static Matrix * csr_csr(Matrix *a, Matrix *b)
+{
+  sparse_scratch_t *s = thread_scratch();
+  const unsigned *av = (const unsigned *) CSR_VALUES(a);
+  const int *arow = CSR_ROWPTR(a);
+  const int *acol = CSR_COLIDX(a);
+  const unsigned *bv = (const unsigned *) CSR_VALUES(b);
+  const int *brow = CSR_ROWPTR(b);
+  const int *bcol = CSR_COLIDX(b);
+  int nnz = 0;
+  ensure_rows(s, a->rows);
+  ensure_cols(s, b->cols);
+  for (int i = 0; i < a->rows; i++)
+  {
+    // a new stamp invalidates every column of the previous row at once
+    if (++s->stamp == 0)
+    {
+      memset(s->mark, 0, sizeof(unsigned) * s->cols_cap);
+      s->stamp = 1;
+    }
+    int touched = 0;
+    for (int p = arow[i]; p < arow[i + 1]; p++)
+    {
+      unsigned x = av[p];
+      int k = acol[p];
+      for (int q = brow[k]; q < brow[k + 1]; q++)
+      {
+        int j = bcol[q];
+        if (s->mark[j] != s->stamp)
+        {
+          s->mark[j] = s->stamp;
+          s->acc[j] = x * bv[q];
+          s->touched[touched++] = j;
+        }
+        else
+          s->acc[j] += x * bv[q];
+      }
+    }
+    qsort(s->touched, touched, sizeof(int), compare_int);
+    s->rowptr[i] = nnz;
+    ensure_nnz(s, nnz + touched);
+    for (int t = 0; t < touched; t++)
+    {
+      s->colidx[nnz] = s->touched[t];
+      s->values[nnz] = (int) s->acc[s->touched[t]];
+      nnz++;
+    }
+  }
+  s->rowptr[a->rows] = nnz;
+  return finish(s, a->rows, b->cols, nnz);
+}
+
+// m1 x m2 where at least one of them is CSR; m1->cols == m2->rows
+Matrix * sparse_multiply(Matrix *m1, Matrix *m2)
+{
+  Matrix *result;
+  if (MATRIX_IS_SPARSE(m1) && MATRIX_IS_SPARSE(m2))
+    result = csr_csr(m1, m2);
+  else
+  {
+    result = AllocMatrix(m1->rows, m2->cols);
+    if (MATRIX_IS_SPARSE(m1))
+      csr_dense(m1, m2, result);
+    else
+      dense_csr(m1, m2, result);
+  }
+  atomic_fetch_add_explicit(&products, 1, memory_order_relaxed);
+  if (MATRIX_IS_SPARSE(result))
+    atomic_fetch_add_explicit(&products_csr, 1, memory_order_relaxed);
+  return result;
+}
+
+long long sparse_sum(Matrix *mat)
+{
+  if (mat->nnz == 0)
+    return 0;
+  // the stored values are one dense row as far as the sum kernels go
+  sum_kernel_t kernel = select_sum_kernel(1, mat->nnz);
+  return kernel(CSR_VALUES(mat), mat->nnz, 1, mat->nnz);
+}
+
+// Dense copy of a CSR matrix, for code that walks rows (display, output)
+Matrix * sparse_to_dense(Matrix *mat)
+{
+  Matrix *dense = AllocMatrix(mat->rows, mat->cols);
+  const int *rowptr = CSR_ROWPTR(mat);
+  const int *colidx = CSR_COLIDX(mat);
+  for (int i = 0; i < mat->rows; i++)
+  {
+    int *mm = MATRIX_ROW(dense, i);
+    memset(mm, 0, sizeof(int) * mat->cols);
+    for (int p = rowptr[i]; p < rowptr[i + 1]; p++)
+      mm[colidx[p]] = CSR_VALUES(mat)[p];
+  }
+  dense->stamp = mat->stamp;
+  dense->sum = mat->sum;
+  return dense;
+}
+
+void sparse_stats(sparse_stats_t *stats)
+{
+  stats->generated = atomic_load(&generated);
+  stats->generated_csr = atomic_load(&generated_csr);
+  stats->products = atomic_load(&products);
+  stats->products_csr = atomic_load(&products_csr);
+}
@@ -0,0 +1,49 @@
+/*
+ *  sparse header
+ *  Function prototypes, data, and constants for the sparse (CSR) matrix module
+ *
+ *  With --density=D below 1 each generated element is nonzero with
+ *  probability D.  Whether a matrix is then stored dense or in
+ *  compressed sparse row form is decided per matrix from its nonzero
+ *  count: CSR once nnz is at most SPARSE_RATIO of rows * cols.  Both
+ *  forms travel through the buffers alike and can be mixed freely in a
+ *  product.
+ *
+ *  A CSR matrix is one allocation like a dense one.  After the header
+ *  come nnz values, then rows + 1 row offsets, then nnz column indices;
+ *  row i's elements are values[rowptr[i] .. rowptr[i + 1] - 1].  Column
+ *  indices within a row are ascending.  CSR matrices are int (ELEM_I32)
+ *  and never pooled.
+ *
+ *  Products with a CSR operand only touch its stored elements.  sparse x
+ *  dense and dense x sparse give a dense product; sparse x sparse is
+ *  built row by row with a dense accumulator (Gustavson) and stored in
+ *  whichever form its own nnz picks.  Arithmetic wraps modulo 2^32 like
+ *  the dense kernels, so every form gives the same product.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Default for --sparse-ratio
+#define DEFAULT_SPARSE_RATIO 0.05
+
+// CSR arrays of a sparse matrix
+#define CSR_VALUES(mat) ((mat)->data)
+#define CSR_ROWPTR(mat) ((mat)->data + (mat)->nnz)
+#define CSR_COLIDX(mat) (CSR_ROWPTR(mat) + (mat)->rows + 1)
+
+// counts across all threads
+typedef struct __sparse_stats_t {
+  unsigned long generated;        // matrices generated with --density
+  unsigned long generated_csr;    // ... of which stored as CSR
+  unsigned long products;         // products with a CSR operand
+  unsigned long products_csr;     // ... whose result is CSR
+} sparse_stats_t;
+
+// sparse methods
+Matrix * sparse_gen(int rows, int cols);
+Matrix * sparse_multiply(Matrix *m1, Matrix *m2);
+long long sparse_sum(Matrix *mat);
+Matrix * sparse_to_dense(Matrix *mat);
+void sparse_stats(sparse_stats_t *stats);
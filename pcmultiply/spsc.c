@@ -0,0 +1,202 @@
+/*
+ *  Per-producer queue routines
+ *
+ *  Positions only ever grow (slot = position % capacity).  The producer
+ *  fills slots, then publishes them with one release store of tail.  A
+ *  consumer reads up to max slots between head and tail, then claims
+ *  them all with one compare-and-swap of head; if another consumer got
+ *  there first the CAS fails and the copies are simply discarded.  The
+ *  producer rereads head only when its cached copy says the queue is full.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "matrix.h"
+#include "spsc.h"
+
+// Number of pause-spins before a blocked thread yields the CPU
+#define SPSC_SPINS 64
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline void backoff(int *spins)
+{
+  if (*spins < SPSC_SPINS)
+  {
+    cpu_relax();
+    (*spins)++;
+  }
+  else
+    sched_yield();
+}
+
+// nqueues queues whose capacities add up to capacity
+int spsc_init(spsc_t *s, int nqueues, int capacity)
+{
+  if (nqueues <= 0 || capacity < nqueues)
+    return -1;
+  s->queues = (spsc_queue_t *) aligned_alloc(CACHE_LINE, sizeof(spsc_queue_t) * nqueues);
+  if (s->queues == NULL)
+    return -1;
+  for (int i = 0; i < nqueues; i++)
+  {
+    spsc_queue_t *q = &s->queues[i];
+    q->capacity = capacity / nqueues + (i < capacity % nqueues);
+    q->slots = (_Atomic(Matrix *) *) malloc(sizeof(q->slots[0]) * q->capacity);
+    if (q->slots == NULL)
+    {
+      s->nqueues = i;
+      spsc_destroy(s);
+      return -1;
+    }
+    for (size_t j = 0; j < q->capacity; j++)
+      atomic_init(&q->slots[j], NULL);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->stolen, 0);
+    q->head_cache = 0;
+  }
+  s->nqueues = nqueues;
+  atomic_init(&s->closed, 0);
+  return 0;
+}
+
+void spsc_destroy(spsc_t *s)
+{
+  for (int i = 0; i < s->nqueues; i++)
+    free(s->queues[i].slots);
+  free(s->queues);
+  s->queues = NULL;
+  s->nqueues = 0;
+}
+
+// Called only by the producer that owns queue 'producer'; returns once
+// all n are queued, waiting for room as needed
+int spsc_put_batch(spsc_t *s, int producer, Matrix **values, int n)
+{
+  spsc_queue_t *q = &s->queues[producer % s->nqueues];
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  int done = 0;
+  int spins = 0;
+  while (done < n)
+  {
+    size_t room = q->capacity - (tail - q->head_cache);
+    if (room == 0)
+    {
+      // Consumers' reads of the slots happen before they advance head
+      q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+      room = q->capacity - (tail - q->head_cache);
+      if (room == 0)
+      {
+        backoff(&spins);
+        continue;
+      }
+    }
+    int k = (room < (size_t) (n - done)) ? (int) room : n - done;
+    for (int i = 0; i < k; i++)
+      atomic_store_explicit(&q->slots[(tail + i) % q->capacity], values[done + i],
+                            memory_order_relaxed);
+    tail += k;
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+    done += k;
+    spins = 0;
+  }
+  return done;
+}
+
+// Take up to max from one queue; 0 if it is empty
+static int try_get(spsc_queue_t *q, Matrix **values, int max)
+{
+  size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  for (;;)
+  {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail)
+      return 0;
+    int k = (tail - head < (size_t) max) ? (int) (tail - head) : max;
+    for (int i = 0; i < k; i++)
+      values[i] = atomic_load_explicit(&q->slots[(head + i) % q->capacity],
+                                       memory_order_relaxed);
+    if (atomic_compare_exchange_weak_explicit(&q->head, &head, head + k,
+          memory_order_acq_rel, memory_order_acquire))
+      return k;
+    // Another consumer moved head; head now holds its new value
+  }
+}
+
+// One pass over every queue, home first
+static int scan(spsc_t *s, int home, Matrix **values, int max)
+{
+  int k = try_get(&s->queues[home], values, max);
+  if (k > 0)
+    return k;
+  for (int i = 1; i < s->nqueues; i++)
+  {
+    spsc_queue_t *q = &s->queues[(home + i) % s->nqueues];
+    k = try_get(q, values, max);
+    if (k > 0)
+    {
+      atomic_fetch_add_explicit(&q->stolen, 1, memory_order_relaxed);
+      return k;
+    }
+  }
+  return 0;
+}
+
+// Blocks until at least one matrix is available in any queue.  Returns
+// the number taken, 0 once closed and every queue is drained.
+int spsc_get_batch(spsc_t *s, int consumer, Matrix **values, int max)
+{
+  int home = consumer % s->nqueues;
+  int spins = 0;
+  for (;;)
+  {
+    int k = scan(s, home, values, max);
+    if (k > 0)
+      return k;
+    if (atomic_load_explicit(&s->closed, memory_order_acquire))
+    {
+      // Every put completed before close, so one more pass is final
+      return scan(s, home, values, max);
+    }
+    backoff(&spins);
+  }
+}
+
+// No more puts will follow; consumers drain the queues and exit
+void spsc_close(spsc_t *s)
+{
+  atomic_store_explicit(&s->closed, 1, memory_order_release);
+}
+
+// Approximate number of matrices in all queues, for monitoring
+size_t spsc_size(spsc_t *s)
+{
+  size_t n = 0;
+  for (int i = 0; i < s->nqueues; i++)
+  {
+    size_t head = atomic_load_explicit(&s->queues[i].head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&s->queues[i].tail, memory_order_relaxed);
+    n += (tail > head) ? tail - head : 0;
+  }
+  return n;
+}
+
+// Batches consumers took from queues other than their home queue
+unsigned long spsc_stolen(spsc_t *s)
+{
+  unsigned long n = 0;
+  for (int i = 0; i < s->nqueues; i++)
+    n += atomic_load_explicit(&s->queues[i].stolen, memory_order_relaxed);
+  return n;
+}
@@ -0,0 +1,46 @@
+/*
+ *  spsc header
+ *  Function prototypes, data, and constants for the per-producer queue module
+ *
+ *  Each producer has a bounded queue of its own, and each consumer a home
+ *  queue it drains first.  Only the owning producer writes a queue's tail
+ *  and, in the common case, only the home consumer moves its head, so a
+ *  handoff touches cache lines shared by exactly those two threads.  A
+ *  consumer whose home queue is empty steals from the others; consumers
+ *  claim with compare-and-swap on the head, so stealing is always safe.
+ *  The queue capacities add up to the bounded buffer size.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+
+// PER-PRODUCER QUEUES
+
+// one producer's queue - tail and head live on separate cache lines
+typedef struct __spsc_queue_t {
+  _Atomic(Matrix *) * slots;
+  size_t capacity;
+  _Alignas(CACHE_LINE) atomic_size_t tail;   // written by the producer only
+  size_t head_cache;                          // producer's last look at head
+  _Alignas(CACHE_LINE) atomic_size_t head;   // advanced by consumers (CAS)
+  atomic_ulong stolen;                        // batches taken by non-home consumers
+} spsc_queue_t;
+
+typedef struct __spsc_t {
+  spsc_queue_t * queues;
+  int nqueues;
+  _Alignas(CACHE_LINE) atomic_int closed;
+} spsc_t;
+
+// spsc methods
+int spsc_init(spsc_t *s, int nqueues, int capacity);
+void spsc_destroy(spsc_t *s);
+int spsc_put_batch(spsc_t *s, int producer, Matrix **values, int n);
+int spsc_get_batch(spsc_t *s, int consumer, Matrix **values, int max);
+void spsc_close(spsc_t *s);
+unsigned long spsc_stolen(spsc_t *s);
+size_t spsc_size(spsc_t *s);
@@ -0,0 +1,300 @@
+/*
+ *  Strassen-Winograd routines
+ *
+ *  One level computes C = A B from the quadrants of A, B and C as
+ *
+ *    S1 = A21 + A22   S2 = S1 - A11   S3 = A11 - A21   S4 = A12 - S2
+ *    T1 = B12 - B11   T2 = B22 - T1   T3 = B22 - B12   T4 = T2 - B21
+ *    P1 = A11 B11  P2 = A12 B21  P3 = S4 B22  P4 = A22 T4
+ *    P5 = S1 T1    P6 = S2 T2    P7 = S3 T3
+ *    U2 = P1 + P6  U3 = U2 + P7  U4 = U2 + P5
+ *    C11 = P1 + P2  C12 = U4 + P3  C21 = U3 - P4  C22 = U3 + P5
+ *
+ *  Below the top level the steps run in the order of Douglas et al.
+ *  (GEMMW), which needs only two quadrant-sized temporaries, X and Y, and
+ *  builds the rest in the quadrants of C.  Every level's temporaries come
+ *  from a per-thread arena sized once per product, so the recursion
+ *  itself never allocates.  With MULT_THREADS > 1 the top level instead
+ *  keeps all seven products apart and runs them as thread pool tasks.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "kernels.h"
+#include "tpool.h"
+#include "blockmult.h"
+#include "strassen.h"
+#include "pcmatrix.h"
+
+// Bump allocator for temporaries; grows only while empty, so pointers
+// handed out are never moved.  Freed by the key destructor at thread exit.
+typedef struct __arena_t {
+  unsigned * base;
+  size_t cap;
+  size_t top;
+} arena_t;
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void free_arena(void *p)
+{
+  arena_t *a = (arena_t *) p;
+  free(a->base);
+  free(a);
+}
+
+static void make_arena_key()
+{
+  pthread_key_create(&arena_key, free_arena);
+}
+
+// This thread's arena, with room for need more elements; NULL if out of memory
+static arena_t * thread_arena(size_t need)
+{
+  pthread_once(&arena_once, make_arena_key);
+  arena_t *a = (arena_t *) pthread_getspecific(arena_key);
+  if (a == NULL)
+  {
+    a = (arena_t *) calloc(1, sizeof(arena_t));
+    if (a == NULL)
+      return NULL;
+    pthread_setspecific(arena_key, a);
+  }
+  if (a->cap - a->top < need)
+  {
+    if (a->top != 0)
+      return NULL;
+    free(a->base);
+    a->base = (unsigned *) aligned_alloc(MATRIX_ALIGN,
+        ((need * sizeof(unsigned) + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN);
+    a->cap = (a->base != NULL) ? need : 0;
+    if (a->base == NULL)
+      return NULL;
+  }
+  return a;
+}
+
+static unsigned * arena_alloc(arena_t *a, size_t n)
+{
+  unsigned *p = a->base + a->top;
+  a->top += n;
+  return p;
+}
+
+// Elements of temporaries the two-temporary recursion needs below order m
+static size_t scratch_size(int m, int depth)
+{
+  size_t total = 0;
+  for (; depth > 0; depth--)
+  {
+    m /= 2;
+    total += 2 * (size_t) m * m;
+  }
+  return total;
+}
+
+// d = x + y and d = x - y on m x m blocks
+static void add(unsigned *d, int sd, const unsigned *x, int sx, const unsigned *y, int sy, int m)
+{
+  for (int i = 0; i < m; i++)
+    for (int j = 0; j < m; j++)
+      d[(size_t) i * sd + j] = x[(size_t) i * sx + j] + y[(size_t) i * sy + j];
+}
+
+static void sub(unsigned *d, int sd, const unsigned *x, int sx, const unsigned *y, int sy, int m)
+{
+  for (int i = 0; i < m; i++)
+    for (int j = 0; j < m; j++)
+      d[(size_t) i * sd + j] = x[(size_t) i * sx + j] - y[(size_t) i * sy + j];
+}
+
+// c = a b, all m x m, recursing depth more levels; scratch holds
+// scratch_size(m, depth) elements
+static void winograd(const unsigned *a, int sa, const unsigned *b, int sb,
+                     unsigned *c, int sc, int m, int depth, unsigned *scratch)
+{
+  if (depth == 0)
+  {
+    mult_kernel_t kernel = select_mult_kernel(m, m, m);
+    kernel((const int *) a, sa, (const int *) b, sb, (int *) c, sc, m, m, m);
+    return;
+  }
+
+  int h = m / 2;
+  const unsigned *a11 = a, *a12 = a + h, *a21 = a + (size_t) h * sa, *a22 = a21 + h;
+  const unsigned *b11 = b, *b12 = b + h, *b21 = b + (size_t) h * sb, *b22 = b21 + h;
+  unsigned *c11 = c, *c12 = c + h, *c21 = c + (size_t) h * sc, *c22 = c21 + h;
+  unsigned *x = scratch;
+  unsigned *y = scratch + (size_t) h * h;
+  unsigned *deeper = y + (size_t) h * h;
+
+  sub(x, h, a11, sa, a21, sa, h);                 // S3
+  sub(y, h, b22, sb, b12, sb, h);                 // T3
+  winograd(x, h, y, h, c21, sc, h, depth - 1, deeper);   // P7
+  add(x, h, a21, sa, a22, sa, h);                 // S1
+  sub(y, h, b12, sb, b11, sb, h);                 // T1
+  winograd(x, h, y, h, c22, sc, h, depth - 1, deeper);   // P5
+  sub(x, h, x, h, a11, sa, h);                    // S2
+  sub(y, h, b22, sb, y, h, h);                    // T2
+  winograd(x, h, y, h, c12, sc, h, depth - 1, deeper);   // P6
+  sub(x, h, a12, sa, x, h, h);                    // S4
+  winograd(x, h, b22, sb, c11, sc, h, depth - 1, deeper);  // P3
+  winograd(a11, sa, b11, sb, x, h, h, depth - 1, deeper);  // P1
+  add(c12, sc, x, h, c12, sc, h);                 // U2 = P1 + P6
+  add(c21, sc, c12, sc, c21, sc, h);              // U3 = U2 + P7
+  add(c12, sc, c12, sc, c22, sc, h);              // U4 = U2 + P5
+  add(c22, sc, c21, sc, c22, sc, h);              // C22 = U3 + P5
+  add(c12, sc, c12, sc, c11, sc, h);              // C12 = U4 + P3
+  sub(y, h, y, h, b21, sb, h);                    // T4
+  winograd(a22, sa, y, h, c11, sc, h, depth - 1, deeper);  // P4
+  sub(c21, sc, c21, sc, c11, sc, h);              // C21 = U3 - P4
+  winograd(a12, sa, b21, sb, c11, sc, h, depth - 1, deeper);  // P2
+  add(c11, sc, x, h, c11, sc, h);                 // C11 = P1 + P2
+}
+
+// The seven top-level products, one thread pool task each
+typedef struct __top_job_t {
+  const unsigned * lhs[7];
+  const unsigned * rhs[7];
+  int sl[7];
+  int sr[7];
+  unsigned * p[7];
+  int h;
+  int depth;              // levels below the top
+  int failed;
+} top_job_t;
+
+static void top_product(void *arg, int task)
+{
+  top_job_t *job = (top_job_t *) arg;
+  size_t need = scratch_size(job->h, job->depth);
+  arena_t *a = thread_arena(need);
+  if (a == NULL)
+  {
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  size_t mark = a->top;
+  winograd(job->lhs[task], job->sl[task], job->rhs[task], job->sr[task],
+           job->p[task], job->h, job->h, job->depth, arena_alloc(a, need));
+  a->top = mark;
+}
+
+// c = a b with the top level's products in parallel; t holds 15 h x h blocks
+static int winograd_parallel(const unsigned *a, int sa, const unsigned *b, int sb,
+                             unsigned *c, int sc, int m, int depth, unsigned *t)
+{
+  int h = m / 2;
+  size_t q = (size_t) h * h;
+  const unsigned *a11 = a, *a12 = a + h, *a21 = a + (size_t) h * sa, *a22 = a21 + h;
+  const unsigned *b11 = b, *b12 = b + h, *b21 = b + (size_t) h * sb, *b22 = b21 + h;
+  unsigned *c11 = c, *c12 = c + h, *c21 = c + (size_t) h * sc, *c22 = c21 + h;
+  unsigned *s1 = t, *s2 = t + q, *s3 = t + 2 * q, *s4 = t + 3 * q;
+  unsigned *t1 = t + 4 * q, *t2 = t + 5 * q, *t3 = t + 6 * q, *t4 = t + 7 * q;
+  unsigned *p = t + 8 * q;
+
+  add(s1, h, a21, sa, a22, sa, h);
+  sub(s2, h, s1, h, a11, sa, h);
+  sub(s3, h, a11, sa, a21, sa, h);
+  sub(s4, h, a12, sa, s2, h, h);
+  sub(t1, h, b12, sb, b11, sb, h);
+  sub(t2, h, b22, sb, t1, h, h);
+  sub(t3, h, b22, sb, b12, sb, h);
+  sub(t4, h, t2, h, b21, sb, h);
+
+  top_job_t job = {
+    { a11, a12, s4, a22, s1, s2, s3 },
+    { b11, b21, b22, t4, t1, t2, t3 },
+    { sa, sa, h, sa, h, h, h },
+    { sb, sb, sb, h, h, h, h },
+    { p, p + q, p + 2 * q, p + 3 * q, p + 4 * q, p + 5 * q, p + 6 * q },
+    h, depth - 1, 0
+  };
+  tpool_run(top_product, &job, 7);
+  if (job.failed)
+    return -1;
+
+  unsigned *p1 = job.p[0], *p2 = job.p[1], *p3 = job.p[2], *p4 = job.p[3];
+  unsigned *p5 = job.p[4], *p6 = job.p[5], *p7 = job.p[6];
+  add(p6, h, p1, h, p6, h, h);        // U2
+  add(p7, h, p6, h, p7, h, h);        // U3
+  add(c11, sc, p1, h, p2, h, h);
+  add(c12, sc, p6, h, p5, h, h);      // U4
+  add(c12, sc, c12, sc, p3, h, h);
+  sub(c21, sc, p7, h, p4, h, h);
+  add(c22, sc, p7, h, p5, h, h);
+  return 0;
+}
+
+// Copy rows x cols elements between strided blocks
+static void copy_block(unsigned *d, int sd, const unsigned *s, int ss, int rows, int cols)
+{
+  for (int i = 0; i < rows; i++)
+    memcpy(d + (size_t) i * sd, s + (size_t) i * ss, sizeof(unsigned) * cols);
+}
+
+// result = m1 * m2 for square m1, m2 of the same order.  Returns -1,
+// leaving result untouched, if the temporaries cannot be allocated.
+int strassen_multiply(Matrix * m1, Matrix * m2, Matrix * result)
+{
+  int n = m1->rows;
+  int leaf = n;
+  int depth = 0;
+  while (leaf > STRASSEN_CROSSOVER)
+  {
+    leaf = (leaf + 1) / 2;
+    depth++;
+  }
+  int np = leaf << depth;
+  int parallel = (MULT_THREADS > 1 && depth > 0);
+  if (parallel)
+    blocked_start_pool();
+
+  size_t padded = (np != n) ? 3 * (size_t) np * np : 0;
+  size_t h = (size_t) (np / 2);
+  size_t temps = parallel ? 15 * h * h + scratch_size((int) h, depth - 1) : scratch_size(np, depth);
+  arena_t *a = thread_arena(padded + temps);
+  if (a == NULL)
+    return -1;
+  size_t mark = a->top;
+
+  const unsigned *pa = (const unsigned *) m1->data;
+  const unsigned *pb = (const unsigned *) m2->data;
+  unsigned *pc = (unsigned *) result->data;
+  int sa = m1->stride, sb = m2->stride, sc = result->stride;
+  if (np != n)
+  {
+    // Zero pad to the order that halves evenly down to leaf
+    unsigned *ea = arena_alloc(a, (size_t) np * np);
+    unsigned *eb = arena_alloc(a, (size_t) np * np);
+    memset(ea, 0, sizeof(unsigned) * (size_t) np * np);
+    memset(eb, 0, sizeof(unsigned) * (size_t) np * np);
+    copy_block(ea, np, pa, sa, n, n);
+    copy_block(eb, np, pb, sb, n, n);
+    pa = ea;
+    pb = eb;
+    pc = arena_alloc(a, (size_t) np * np);
+    sa = sb = sc = np;
+  }
+
+  // In parallel the scratch below the top level stays free for the task
+  // this thread runs itself
+  int rc = 0;
+  if (parallel)
+    rc = winograd_parallel(pa, sa, pb, sb, pc, sc, np, depth, arena_alloc(a, 15 * h * h));
+  else
+    winograd(pa, sa, pb, sb, pc, sc, np, depth, arena_alloc(a, temps));
+
+  if (rc == 0 && np != n)
+    copy_block((unsigned *) result->data, result->stride, pc, np, n, n);
+  a->top = mark;
+  return rc;
+}
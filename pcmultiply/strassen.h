@@ -0,0 +1,28 @@
+/*
+ *  strassen header
+ *  Function prototypes, data, and constants for the Strassen-Winograd module
+ *
+ *  Square products of order STRASSEN_THRESHOLD or more are split into
+ *  quadrants recursively and multiplied with Winograd's variant of
+ *  Strassen's algorithm: 7 half-size products and 15 additions per level
+ *  instead of 8 products.  Recursion stops once the quadrants are no
+ *  larger than STRASSEN_CROSSOVER, where the ordinary multiply kernels
+ *  take over.  An order that does not halve evenly down to that size is
+ *  zero padded up to the next one that does (at most a few rows).
+ *
+ *  Elements are added, subtracted and multiplied as unsigned ints, i.e.
+ *  modulo 2^32, exactly like the classic kernels, so the product is bit
+ *  for bit the one MatrixMultiply() would give without this module.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Defaults for --strassen and --strassen-crossover
+#define DEFAULT_STRASSEN_THRESHOLD 512
+#define DEFAULT_STRASSEN_CROSSOVER 64
+
+// STRASSEN-WINOGRAD
+
+// strassen methods
+int strassen_multiply(Matrix * m1, Matrix * m2, Matrix * result);
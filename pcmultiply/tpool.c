@@ -0,0 +1,153 @@
+/*
+ *  Thread pool routines
+ *
+ *  Tasks are coarse (a tile of a large matrix product), so the job queue
+ *  is kept simple: one mutex, one condition for "work available" and one
+ *  for "task finished".
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "tpool.h"
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t task_done = PTHREAD_COND_INITIALIZER;
+
+static tpool_job_t * jobs_head = NULL;
+static tpool_job_t * jobs_tail = NULL;
+static pthread_t * helpers = NULL;
+static int nhelpers = 0;
+static int shutting_down = 0;
+
+// Claim the next task of the job at the head of the queue (pool_mutex
+// held).  Once its last task is handed out, the job leaves the queue.
+static int claim_task(tpool_job_t *job)
+{
+  int task = job->next++;
+  if (job->next == job->ntasks)
+  {
+    jobs_head = job->link;
+    if (jobs_head == NULL)
+      jobs_tail = NULL;
+  }
+  return task;
+}
+
+static void finish_task(tpool_job_t *job)
+{
+  pthread_mutex_lock(&pool_mutex);
+  job->finished++;
+  if (job->finished == job->ntasks)
+    pthread_cond_broadcast(&task_done);
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+static void *helper(void *arg)
+{
+  pthread_mutex_lock(&pool_mutex);
+  for (;;)
+  {
+    while (jobs_head == NULL && !shutting_down)
+      pthread_cond_wait(&work_ready, &pool_mutex);
+    if (jobs_head == NULL)
+      break;
+    tpool_job_t *job = jobs_head;
+    int task = claim_task(job);
+    pthread_mutex_unlock(&pool_mutex);
+
+    job->fn(job->arg, task);
+    finish_task(job);
+
+    pthread_mutex_lock(&pool_mutex);
+  }
+  pthread_mutex_unlock(&pool_mutex);
+  return NULL;
+}
+
+// Start nthreads - 1 helpers (the caller of tpool_run() is the other one)
+int tpool_init(int nthreads)
+{
+  if (nthreads < 2)
+    return 0;
+  helpers = (pthread_t *) malloc(sizeof(pthread_t) * (nthreads - 1));
+  if (helpers == NULL)
+    return -1;
+  for (int i = 0; i < nthreads - 1; i++)
+  {
+    if (pthread_create(&helpers[i], NULL, helper, NULL) != 0)
+      break;
+    nhelpers++;
+  }
+  return 0;
+}
+
+// Run fn(arg, 0..ntasks-1) across the pool and the calling thread;
+// returns once every task has completed
+void tpool_run(tpool_fn_t fn, void *arg, int ntasks)
+{
+  if (ntasks <= 0)
+    return;
+  if (nhelpers == 0 || ntasks == 1)
+  {
+    for (int t = 0; t < ntasks; t++)
+      fn(arg, t);
+    return;
+  }
+
+  tpool_job_t job = { fn, arg, ntasks, 0, 0, NULL };
+  pthread_mutex_lock(&pool_mutex);
+  if (jobs_tail == NULL)
+    jobs_head = &job;
+  else
+    jobs_tail->link = &job;
+  jobs_tail = &job;
+  pthread_cond_broadcast(&work_ready);
+
+  // Work on our own job until all of its tasks are handed out
+  while (job.next < job.ntasks)
+  {
+    int task = job.next++;
+    if (job.next == job.ntasks)
+    {
+      // Unlink our job, which may be anywhere in the queue
+      tpool_job_t **pp = &jobs_head;
+      tpool_job_t *prev = NULL;
+      while (*pp != &job)
+      {
+        prev = *pp;
+        pp = &(*pp)->link;
+      }
+      *pp = job.link;
+      if (jobs_tail == &job)
+        jobs_tail = prev;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    fn(arg, task);
+    pthread_mutex_lock(&pool_mutex);
+    job.finished++;
+  }
+
+  // Wait for helpers still running our tasks
+  while (job.finished < job.ntasks)
+    pthread_cond_wait(&task_done, &pool_mutex);
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+void tpool_shutdown()
+{
+  pthread_mutex_lock(&pool_mutex);
+  shutting_down = 1;
+  pthread_cond_broadcast(&work_ready);
+  pthread_mutex_unlock(&pool_mutex);
+  for (int i = 0; i < nhelpers; i++)
+    pthread_join(helpers[i], NULL);
+  free(helpers);
+  helpers = NULL;
+  nhelpers = 0;
+}
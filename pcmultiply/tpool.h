@@ -0,0 +1,31 @@
+/*
+ *  tpool header
+ *  Function prototypes, data, and constants for the thread pool module
+ *
+ *  A fixed set of helper threads that run the tasks of parallel jobs.
+ *  The thread submitting a job works on it too, so a job always makes
+ *  progress, and several consumers may submit jobs at the same time.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// THREAD POOL
+
+// task body: called once for every task index in [0, ntasks)
+typedef void (*tpool_fn_t)(void *arg, int task);
+
+// one parallel job; lives on the submitting thread's stack
+typedef struct __tpool_job_t {
+  tpool_fn_t fn;
+  void * arg;
+  int ntasks;
+  int next;                      // next task index to hand out
+  int finished;                  // tasks completed
+  struct __tpool_job_t * link;   // queue of jobs with tasks left
+} tpool_job_t;
+
+// thread pool methods
+int tpool_init(int nthreads);
+void tpool_run(tpool_fn_t fn, void *arg, int ntasks);
+void tpool_shutdown();
@@ -0,0 +1,97 @@
+/*
+ *  Spin-then-futex wait routines
+ *
+ *  A lost wakeup is ruled out by the order of two sequentially consistent
+ *  operations on each side: a waker bumps seq and then reads sleepers,
+ *  a sleeper raises sleepers and then FUTEX_WAIT checks seq.  Either the
+ *  waker sees the sleeper and wakes it, or the kernel sees the new seq
+ *  and returns at once.  The sleeper reads its starting seq while still
+ *  holding the buffer mutex, so no change made under the mutex after its
+ *  check can slip by unseen.
+ *
+ *  Waking is not a handoff: a woken thread retakes the mutex and checks
+ *  the buffer again, exactly as after pthread_cond_wait().
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "waitq.h"
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static void futex_wait(atomic_uint *word, unsigned val)
+{
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *word, int n)
+{
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+void waitq_init(waitq_t *q)
+{
+  atomic_init(&q->seq, 0);
+  atomic_init(&q->sleepers, 0);
+  q->spin_max = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? WAITQ_SPIN_MAX : 0;
+  atomic_init(&q->spin_limit, q->spin_max ? WAITQ_SPIN_START : 0);
+  atomic_init(&q->spin_hits, 0);
+  atomic_init(&q->sleeps, 0);
+  atomic_init(&q->wake_calls, 0);
+}
+
+// Release m, wait for the next waitq_wake() (or a spurious return) and
+// retake m.  Callers recheck their condition in a loop.
+void waitq_wait(waitq_t *q, pthread_mutex_t *m)
+{
+  unsigned seq = atomic_load(&q->seq);
+  pthread_mutex_unlock(m);
+
+  int limit = atomic_load_explicit(&q->spin_limit, memory_order_relaxed);
+  for (int i = 0; i < limit; i++)
+  {
+    cpu_relax();
+    if (atomic_load_explicit(&q->seq, memory_order_acquire) != seq)
+    {
+      atomic_fetch_add_explicit(&q->spin_hits, 1, memory_order_relaxed);
+      if (limit < q->spin_max)
+        atomic_store_explicit(&q->spin_limit, limit + limit / 8 + 1, memory_order_relaxed);
+      pthread_mutex_lock(m);
+      return;
+    }
+  }
+  if (limit > WAITQ_SPIN_MIN)
+    atomic_store_explicit(&q->spin_limit, limit - limit / 8, memory_order_relaxed);
+
+  atomic_fetch_add(&q->sleepers, 1);
+  if (atomic_load(&q->seq) == seq)
+  {
+    atomic_fetch_add_explicit(&q->sleeps, 1, memory_order_relaxed);
+    futex_wait(&q->seq, seq);
+  }
+  atomic_fetch_sub(&q->sleepers, 1);
+  pthread_mutex_lock(m);
+}
+
+// Wake up to n waiters; spinning waiters see the new seq on their own
+void waitq_wake(waitq_t *q, int n)
+{
+  atomic_fetch_add(&q->seq, 1);
+  if (atomic_load(&q->sleepers) > 0)
+  {
+    atomic_fetch_add_explicit(&q->wake_calls, 1, memory_order_relaxed);
+    futex_wake(&q->seq, n);
+  }
+}
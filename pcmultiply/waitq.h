@@ -0,0 +1,48 @@
+/*
+ *  waitq header
+ *  Function prototypes, data, and constants for the spin-then-futex wait module
+ *
+ *  A waitq stands in for a condition variable on the condvar buffer
+ *  (--wait=futex).  waitq_wait() is called with the buffer mutex held,
+ *  like pthread_cond_wait(): it drops the mutex, spins on the waitq's
+ *  sequence word for a while with pause, and only then sleeps on it
+ *  with FUTEX_WAIT.  Every waitq_wake() bumps the sequence, which ends
+ *  the spins, but makes a FUTEX_WAKE system call only when some thread
+ *  is actually asleep.
+ *
+ *  The spin budget adapts per waitq: it grows when spinning ended the
+ *  wait and shrinks when the thread had to sleep anyway.  With a single
+ *  online CPU nothing can change while we spin, so the budget is zero.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Adaptive spin budget bounds, in pause iterations
+#define WAITQ_SPIN_MIN 16
+#define WAITQ_SPIN_MAX 4096
+#define WAITQ_SPIN_START 256
+
+// Wake everyone, for waitq_wake()
+#define WAITQ_ALL 0x7fffffff
+
+// SPIN-THEN-FUTEX WAIT QUEUE
+
+typedef struct __waitq_t {
+  _Alignas(64) atomic_uint seq;   // futex word, bumped by every wake
+  atomic_int sleepers;            // threads in (or entering) FUTEX_WAIT
+  atomic_int spin_limit;
+  int spin_max;                   // 0 on a single CPU
+  atomic_ulong spin_hits;         // waits ended while spinning
+  atomic_ulong sleeps;            // waits that went to sleep in the kernel
+  atomic_ulong wake_calls;        // FUTEX_WAKE system calls made (condvar wakes
+                                  // when the buffer waits on a condvar instead)
+} waitq_t;
+
+// waitq methods
+void waitq_init(waitq_t *q);
+void waitq_wait(waitq_t *q, pthread_mutex_t *m);
+void waitq_wake(waitq_t *q, int n);
@@ -0,0 +1,223 @@
+/*
+ *  Output writer routines
+ *
+ *  Full buffers travel to the writer thread on a FIFO queue and come
+ *  back on a free list, so the steady state allocates nothing.  A block
+ *  larger than WRITER_BUFSIZE gets a buffer of its own size, which is
+ *  released instead of recycled.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include libraries required for this module only
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "writer.h"
+
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;     // writer waits here
+static pthread_cond_t released = PTHREAD_COND_INITIALIZER;   // consumers wait here
+
+static outbuf_t * queue_head = NULL;
+static outbuf_t * queue_tail = NULL;
+static outbuf_t * free_list = NULL;
+static int nbuffers = 0;
+static int stopping = 0;
+static int out_fd = 1;
+static pthread_t writer_thread;
+
+// This thread's partially filled buffer
+static __thread outbuf_t * current = NULL;
+
+static outbuf_t * new_buffer(size_t cap)
+{
+  outbuf_t *b = (outbuf_t *) malloc(sizeof(outbuf_t));
+  if (b == NULL)
+    return NULL;
+  b->data = (char *) malloc(cap);
+  if (b->data == NULL)
+  {
+    free(b);
+    return NULL;
+  }
+  b->len = 0;
+  b->cap = cap;
+  b->next = NULL;
+  return b;
+}
+
+static void free_outbuf(outbuf_t *b)
+{
+  free(b->data);
+  free(b);
+}
+
+// write() all of it, retrying short writes and interrupts
+static void write_all(const char *p, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(out_fd, p, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("writer");
+      return;
+    }
+    p += n;
+    len -= (size_t) n;
+  }
+}
+
+static void *writer_main(void *arg)
+{
+  pthread_mutex_lock(&writer_mutex);
+  for (;;)
+  {
+    while (queue_head == NULL && !stopping)
+      pthread_cond_wait(&queued, &writer_mutex);
+    if (queue_head == NULL)
+      break;
+    outbuf_t *b = queue_head;
+    queue_head = b->next;
+    if (queue_head == NULL)
+      queue_tail = NULL;
+    pthread_mutex_unlock(&writer_mutex);
+
+    write_all(b->data, b->len);
+
+    pthread_mutex_lock(&writer_mutex);
+    if (b->cap == WRITER_BUFSIZE)
+    {
+      b->len = 0;
+      b->next = free_list;
+      free_list = b;
+    }
+    else
+    {
+      free_outbuf(b);
+      nbuffers--;
+    }
+    pthread_cond_signal(&released);
+  }
+  pthread_mutex_unlock(&writer_mutex);
+  return NULL;
+}
+
+// Queue a buffer to the writer
+static void submit(outbuf_t *b)
+{
+  pthread_mutex_lock(&writer_mutex);
+  b->next = NULL;
+  if (queue_tail == NULL)
+    queue_head = b;
+  else
+    queue_tail->next = b;
+  queue_tail = b;
+  pthread_cond_signal(&queued);
+  pthread_mutex_unlock(&writer_mutex);
+}
+
+// A buffer with room for cap bytes, waiting while too many are in flight
+static outbuf_t * acquire(size_t cap)
+{
+  outbuf_t *b = NULL;
+  pthread_mutex_lock(&writer_mutex);
+  for (;;)
+  {
+    if (cap <= WRITER_BUFSIZE && free_list != NULL)
+    {
+      b = free_list;
+      free_list = b->next;
+      break;
+    }
+    if (nbuffers < WRITER_MAX_BUFFERS)
+    {
+      nbuffers++;
+      break;
+    }
+    pthread_cond_wait(&released, &writer_mutex);
+  }
+  pthread_mutex_unlock(&writer_mutex);
+
+  if (b == NULL)
+  {
+    b = new_buffer(cap > WRITER_BUFSIZE ? cap : WRITER_BUFSIZE);
+    if (b == NULL)
+    {
+      pthread_mutex_lock(&writer_mutex);
+      nbuffers--;
+      pthread_mutex_unlock(&writer_mutex);
+    }
+  }
+  return b;
+}
+
+// Start the writer thread; output goes to file descriptor fd
+int writer_start(int fd)
+{
+  out_fd = fd;
+  stopping = 0;
+  return pthread_create(&writer_thread, NULL, writer_main, NULL);
+}
+
+// Room for n bytes of output in this thread's buffer.  Format at most n
+// bytes there, then call writer_commit() with the number actually used.
+char * writer_reserve(size_t n)
+{
+  if (current != NULL && current->cap - current->len < n)
+  {
+    submit(current);
+    current = NULL;
+  }
+  if (current == NULL)
+  {
+    current = acquire(n);
+    if (current == NULL)
+      return NULL;
+  }
+  return current->data + current->len;
+}
+
+void writer_commit(size_t n)
+{
+  current->len += n;
+  if (current->len >= WRITER_FLUSH)
+  {
+    submit(current);
+    current = NULL;
+  }
+}
+
+// Queue whatever this thread has buffered; call before the thread exits
+void writer_flush_thread()
+{
+  if (current == NULL)
+    return;
+  // An empty buffer goes back to the pool through the writer like any other
+  submit(current);
+  current = NULL;
+}
+
+// Write out everything queued, then stop the writer thread
+void writer_stop()
+{
+  pthread_mutex_lock(&writer_mutex);
+  stopping = 1;
+  pthread_cond_signal(&queued);
+  pthread_mutex_unlock(&writer_mutex);
+  pthread_join(writer_thread, NULL);
+
+  while (free_list != NULL)
+  {
+    outbuf_t *b = free_list;
+    free_list = b->next;
+    free_outbuf(b);
+  }
+  nbuffers = 0;
+}
@@ -0,0 +1,36 @@
+/*
+ *  writer header
+ *  Function prototypes, data, and constants for the output writer module
+ *
+ *  Consumers format their output into a thread-local buffer; full
+ *  buffers are queued to a dedicated writer thread that hands them to
+ *  write(2) in one call each.  A caller reserves room for a whole block
+ *  of output before formatting it, so a block never straddles two
+ *  buffers and blocks from different consumers never interleave.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Buffer size; a buffer is queued once it holds at least WRITER_FLUSH bytes
+#define WRITER_BUFSIZE (128 * 1024)
+#define WRITER_FLUSH (64 * 1024)
+
+// Buffers allowed to exist at once; consumers wait when the writer falls behind
+#define WRITER_MAX_BUFFERS 64
+
+// OUTPUT WRITER
+
+typedef struct __outbuf_t {
+  char * data;
+  size_t len;
+  size_t cap;
+  struct __outbuf_t * next;
+} outbuf_t;
+
+// writer methods
+int writer_start(int fd);
+char * writer_reserve(size_t n);
+void writer_commit(size_t n);
+void writer_flush_thread();
+void writer_stop();